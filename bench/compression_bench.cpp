@@ -0,0 +1,276 @@
+// Bytes on the wire and server CPU of GET / state polls, the response every
+// client repeats, under the server's compression_level. The lobby is filled
+// with --players players first so the state is the size of a busy game.
+// Every connection polls back to back over keep-alive; with --mutate-every a
+// player joins after that many polls, which moves the state to a new version
+// and makes the server compress it again.
+//
+//   compression-bench [--host 127.0.0.1] [--port 8080] [--connections 8]
+//                     [--seconds 10] [--players 200] [--mutate-every 0]
+//                     [--encoding gzip] [--server-pid PID]
+//
+// --encoding is sent as Accept-Encoding; identity gives the uncompressed
+// baseline. With --server-pid the server's CPU time per poll is reported,
+// the price of the level.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;
+    int seconds = 10;
+    int players = 200;
+    int mutate_every = 0;
+    std::string encoding = "gzip";
+    int server_pid = 0;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string inbox;
+};
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") options.host = value;
+        else if (key == "--port") options.port = std::stoi(value);
+        else if (key == "--connections") options.connections = std::max(1, std::stoi(value));
+        else if (key == "--seconds") options.seconds = std::stoi(value);
+        else if (key == "--players") options.players = std::max(0, std::stoi(value));
+        else if (key == "--mutate-every") options.mutate_every = std::max(0, std::stoi(value));
+        else if (key == "--encoding") options.encoding = value;
+        else if (key == "--server-pid") options.server_pid = std::stoi(value);
+        else {
+            std::cerr << "unknown option " << key << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+// utime + stime of a process in seconds
+double process_cpu_seconds(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return 0;
+    // fields after the parenthesised command name, which may contain spaces
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int index = 3; fields >> field; ++index) {
+        if (index == 14) utime = std::stoull(field);
+        if (index == 15) {
+            stime = std::stoull(field);
+            break;
+        }
+    }
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int connect_to(const Options& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = inet_addr(options.host.c_str());
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Size of the first complete response in inbox, 0 while it is incomplete.
+std::size_t response_size(const std::string& inbox) {
+    auto end = inbox.find("\r\n\r\n");
+    if (end == std::string::npos) return 0;
+    std::size_t body = 0;
+    auto header = inbox.find("Content-Length: ");
+    if (header != std::string::npos && header < end) {
+        body = std::strtoul(inbox.c_str() + header + 16, nullptr, 10);
+    }
+    std::size_t total = end + 4 + body;
+    return inbox.size() >= total ? total : 0;
+}
+
+std::string post(const Options& options, const std::string& path, const std::string& body) {
+    return "POST " + path + " HTTP/1.1\r\n"
+           "Host: " + options.host + "\r\n"
+           "Content-Type: application/json\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Sends request on fd and waits for its answer; false if the connection broke.
+bool round_trip(int fd, const std::string& request) {
+    if (!send_all(fd, request)) return false;
+    std::string inbox;
+    char buffer[4096];
+    while (response_size(inbox) == 0) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) return false;
+        inbox.append(buffer, static_cast<std::size_t>(received));
+    }
+    return true;
+}
+
+bool join(const Options& options, int fd, const std::string& player) {
+    return round_trip(fd, post(options, "/join", "{\"player_name\":\"" + player + "\"}"));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    const std::string body =
+        "{\"player_name\":\"bench-0\",\"timestamp\":\"2026-01-01T00:00:00Z\"}";
+    const std::string request =
+        "GET / HTTP/1.1\r\n"
+        "Host: " + options.host + "\r\n"
+        "Accept-Encoding: " + options.encoding + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    // names are unique per run, so a server that is reused keeps growing
+    // rather than answering 403 to every join
+    const std::string prefix = "bench-" + std::to_string(getpid()) + "-";
+    int control_fd = connect_to(options);
+    if (control_fd == -1) {
+        std::cerr << "failed to connect to " << options.host << ":" << options.port << std::endl;
+        return 1;
+    }
+    int joined = 0;
+    for (; joined < options.players; ++joined) {
+        if (!join(options, control_fd, prefix + std::to_string(joined))) {
+            std::cerr << "failed to join players" << std::endl;
+            return 1;
+        }
+    }
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<Connection> connections(options.connections);
+    for (auto& connection : connections) {
+        connection.fd = connect_to(options);
+        if (connection.fd == -1) {
+            std::cerr << "failed to connect to " << options.host << ":" << options.port << std::endl;
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &ev);
+    }
+
+    std::uint64_t polls = 0;
+    std::uint64_t wire_bytes = 0;
+    std::uint64_t encoded = 0;
+    std::uint64_t not_modified = 0;
+    int mutations = 0;
+    double cpu_before = options.server_pid ? process_cpu_seconds(options.server_pid) : 0;
+    auto started = Clock::now();
+    auto deadline = started + std::chrono::seconds(options.seconds);
+    for (auto& connection : connections) {
+        if (!send_all(connection.fd, request)) {
+            std::cerr << "failed to send request" << std::endl;
+            return 1;
+        }
+    }
+    std::vector<struct epoll_event> events(options.connections);
+    char buffer[65536];
+
+    while (Clock::now() < deadline) {
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < n; ++i) {
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                std::cerr << "server closed a connection" << std::endl;
+                return 1;
+            }
+            connection->inbox.append(buffer, static_cast<std::size_t>(received));
+            std::size_t size = response_size(connection->inbox);
+            if (size == 0) continue;
+
+            std::string_view header(connection->inbox.data(), connection->inbox.find("\r\n\r\n"));
+            if (header.find("Content-Encoding: ") != std::string_view::npos) ++encoded;
+            if (header.find(" 304 ") != std::string_view::npos) ++not_modified;
+            ++polls;
+            wire_bytes += size;
+            connection->inbox.erase(0, size);
+
+            if (options.mutate_every > 0 && polls % options.mutate_every == 0) {
+                if (!join(options, control_fd, prefix + std::to_string(joined++))) {
+                    std::cerr << "failed to join a player" << std::endl;
+                    return 1;
+                }
+                ++mutations;
+            }
+            if (!send_all(connection->fd, request)) {
+                std::cerr << "failed to send request" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    std::printf("connections     %d\n", options.connections);
+    std::printf("players         %d\n", joined);
+    std::printf("encoding        %s\n", options.encoding.c_str());
+    std::printf("polls           %llu (%.0f/s)\n", static_cast<unsigned long long>(polls), polls / elapsed);
+    std::printf("state versions  %d\n", mutations + 1);
+    std::printf("encoded         %llu\n", static_cast<unsigned long long>(encoded));
+    if (not_modified) std::printf("not modified    %llu\n", static_cast<unsigned long long>(not_modified));
+    std::printf("bytes per poll  %.0f\n", polls ? static_cast<double>(wire_bytes) / polls : 0.0);
+    std::printf("wire            %.1f MB/s\n", wire_bytes / elapsed / 1e6);
+    if (options.server_pid) {
+        double cpu = process_cpu_seconds(options.server_pid) - cpu_before;
+        std::printf("server cpu      %.2f s (%.1f us per poll)\n", cpu, polls ? 1e6 * cpu / polls : 0.0);
+    }
+
+    for (auto& connection : connections) close(connection.fd);
+    close(control_fd);
+    close(epoll_fd);
+    return 0;
+}
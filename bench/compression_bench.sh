@@ -0,0 +1,49 @@
+#!/usr/bin/env bash
+# Measures bytes per state poll and server CPU against a fresh server at each
+# compression level; level 0 sends bodies uncompressed.
+# Usage: bench/compression_bench.sh [players] [connections] [seconds] [mutate_every] [encoding]
+set -euo pipefail
+
+project_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+build_dir="${project_dir}/build/bench"
+players="${1:-200}"
+connections="${2:-8}"
+seconds="${3:-10}"
+mutate_every="${4:-0}"
+encoding="${5:-gzip}"
+
+cmake -S "${project_dir}" -B "${build_dir}" -DCMAKE_BUILD_TYPE=Release -DWORDLE_BUILD_BENCHMARKS=ON
+cmake --build "${build_dir}" --target wordle-server compression-bench
+
+run_dir="$(mktemp -d)"
+trap 'rm -rf "${run_dir}"' EXIT
+
+for level in 0 1 6 9; do
+    cat > "${run_dir}/conf.json" <<CONF
+{
+    "http_port": "18080",
+    "websocket_port": "14040",
+    "address": "127.0.0.1",
+    "http_reactors": "1",
+    "websocket_reactors": "1",
+    "http_max_requests": "0",
+    "compression_level": "${level}",
+    "debug": "false",
+    "info": "false",
+    "warn": "true",
+    "error": "true",
+    "mock": "false"
+}
+CONF
+    (cd "${run_dir}" && exec "${build_dir}/wordle-server") &
+    server_pid=$!
+    sleep 1
+
+    echo "== compression_level ${level}"
+    "${build_dir}/compression-bench" --port 18080 --connections "${connections}" \
+        --seconds "${seconds}" --players "${players}" --mutate-every "${mutate_every}" \
+        --encoding "${encoding}" --server-pid "${server_pid}" || true
+
+    kill "${server_pid}"
+    wait "${server_pid}" 2>/dev/null || true
+done
@@ -0,0 +1,241 @@
+// Round-trip latency of POST /guess, the request tournament rounds are
+// decided on, reported as percentiles so the reactors' blocking and busy
+// poll modes can be compared on the tail. Each connection sends one guess,
+// waits for the answer and pauses for --interval before the next, so the
+// server sits idle between requests the way it does between a player's
+// guesses; a saturated server never waits and both modes look alike.
+//
+//   guess-latency-bench [--host 127.0.0.1] [--port 8080] [--connections 8]
+//                       [--seconds 10] [--interval-us 2000] [--server-pid PID]
+//
+// Without a game in progress the answer is 404 Game not found, which takes
+// the same parse, route and game state lock as an accepted guess. With
+// --server-pid the server's CPU time over the run is reported as well, the
+// price of the busy poll mode.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;
+    int seconds = 10;
+    int interval_us = 2000;
+    int server_pid = 0;
+};
+
+struct Connection {
+    int fd = -1;
+    bool waiting = false;
+    std::string inbox;
+    Clock::time_point sent_at;
+    Clock::time_point next_send;
+};
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") options.host = value;
+        else if (key == "--port") options.port = std::stoi(value);
+        else if (key == "--connections") options.connections = std::max(1, std::stoi(value));
+        else if (key == "--seconds") options.seconds = std::stoi(value);
+        else if (key == "--interval-us") options.interval_us = std::max(0, std::stoi(value));
+        else if (key == "--server-pid") options.server_pid = std::stoi(value);
+        else {
+            std::cerr << "unknown option " << key << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+// utime + stime of a process in seconds
+double process_cpu_seconds(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return 0;
+    // fields after the parenthesised command name, which may contain spaces
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int index = 3; fields >> field; ++index) {
+        if (index == 14) utime = std::stoull(field);
+        if (index == 15) {
+            stime = std::stoull(field);
+            break;
+        }
+    }
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int connect_to(const Options& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = inet_addr(options.host.c_str());
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Size of the first complete response in inbox, 0 while it is incomplete.
+std::size_t response_size(const std::string& inbox) {
+    auto end = inbox.find("\r\n\r\n");
+    if (end == std::string::npos) return 0;
+    std::size_t body = 0;
+    auto header = inbox.find("Content-Length: ");
+    if (header != std::string::npos && header < end) {
+        body = std::strtoul(inbox.c_str() + header + 16, nullptr, 10);
+    }
+    std::size_t total = end + 4 + body;
+    return inbox.size() >= total ? total : 0;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    std::size_t index = static_cast<std::size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    const std::string body =
+        "{\"player_name\":\"bench\",\"timestamp\":\"2026-01-01T00:00:00Z\",\"guess\":\"crane\"}";
+    const std::string request =
+        "POST /guess HTTP/1.1\r\n"
+        "Host: " + options.host + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    const auto interval = std::chrono::microseconds(options.interval_us);
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<Connection> connections(options.connections);
+    for (auto& connection : connections) {
+        connection.fd = connect_to(options);
+        if (connection.fd == -1) {
+            std::cerr << "failed to connect to " << options.host << ":" << options.port << std::endl;
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &ev);
+    }
+
+    std::vector<double> round_trips_us;
+    double cpu_before = options.server_pid ? process_cpu_seconds(options.server_pid) : 0;
+    auto started = Clock::now();
+    auto deadline = started + std::chrono::seconds(options.seconds);
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        // staggered, so the connections do not send in lockstep
+        connections[i].next_send = started + interval * i / connections.size();
+    }
+    std::vector<struct epoll_event> events(options.connections);
+    char buffer[4096];
+
+    while (Clock::now() < deadline) {
+        auto now = Clock::now();
+        auto next_due = deadline;
+        for (auto& connection : connections) {
+            if (connection.waiting) continue;
+            if (connection.next_send <= now) {
+                connection.sent_at = Clock::now();
+                connection.waiting = true;
+                if (!send_all(connection.fd, request)) {
+                    std::cerr << "failed to send request" << std::endl;
+                    return 1;
+                }
+            } else {
+                next_due = std::min(next_due, connection.next_send);
+            }
+        }
+
+        // millisecond timeouts would stretch the sub-millisecond pauses,
+        // so the last stretch before a send is polled
+        auto until_due = std::chrono::duration_cast<std::chrono::milliseconds>(next_due - Clock::now());
+        int timeout_ms = static_cast<int>(std::max<long long>(0, until_due.count() - 1));
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                std::cerr << "server closed a connection" << std::endl;
+                return 1;
+            }
+            connection->inbox.append(buffer, static_cast<std::size_t>(received));
+            std::size_t size = response_size(connection->inbox);
+            if (size == 0) continue;
+
+            auto answered = Clock::now();
+            round_trips_us.push_back(
+                std::chrono::duration<double, std::micro>(answered - connection->sent_at).count());
+            connection->inbox.erase(0, size);
+            connection->waiting = false;
+            connection->next_send = answered + interval;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    std::sort(round_trips_us.begin(), round_trips_us.end());
+    std::printf("connections     %d\n", options.connections);
+    std::printf("interval        %d us\n", options.interval_us);
+    std::printf("guesses         %zu\n", round_trips_us.size());
+    std::printf("p50             %.1f us\n", percentile(round_trips_us, 0.50));
+    std::printf("p90             %.1f us\n", percentile(round_trips_us, 0.90));
+    std::printf("p99             %.1f us\n", percentile(round_trips_us, 0.99));
+    std::printf("p99.9           %.1f us\n", percentile(round_trips_us, 0.999));
+    std::printf("max             %.1f us\n", round_trips_us.empty() ? 0.0 : round_trips_us.back());
+    if (options.server_pid) {
+        double cpu = process_cpu_seconds(options.server_pid) - cpu_before;
+        std::printf("server cpu      %.2f s (%.1f%% of one core)\n", cpu, 100.0 * cpu / elapsed);
+    }
+
+    for (auto& connection : connections) close(connection.fd);
+    close(epoll_fd);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+# Measures the /guess round trip against a fresh server once with blocking
+# reactors and once with busy polling ones.
+# Usage: bench/guess_latency_bench.sh [spin_us] [connections] [seconds] [backend]
+set -euo pipefail
+
+project_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+build_dir="${project_dir}/build/bench"
+spin_us="${1:-200}"
+connections="${2:-8}"
+seconds="${3:-10}"
+backend="${4:-epoll}"
+
+cmake -S "${project_dir}" -B "${build_dir}" -DCMAKE_BUILD_TYPE=Release -DWORDLE_BUILD_BENCHMARKS=ON
+cmake --build "${build_dir}" --target wordle-server guess-latency-bench
+
+run_dir="$(mktemp -d)"
+trap 'rm -rf "${run_dir}"' EXIT
+
+for spin in 0 "${spin_us}"; do
+    cat > "${run_dir}/conf.json" <<CONF
+{
+    "http_port": "18080",
+    "websocket_port": "14040",
+    "address": "127.0.0.1",
+    "io_backend": "${backend}",
+    "http_reactors": "1",
+    "websocket_reactors": "1",
+    "reactor_spin_us": "${spin}",
+    "debug": "false",
+    "info": "false",
+    "warn": "true",
+    "error": "true",
+    "mock": "false"
+}
+CONF
+    (cd "${run_dir}" && exec "${build_dir}/wordle-server") &
+    server_pid=$!
+    sleep 1
+
+    echo "== reactor_spin_us ${spin}"
+    "${build_dir}/guess-latency-bench" --port 18080 --connections "${connections}" \
+        --seconds "${seconds}" --server-pid "${server_pid}" || true
+
+    kill "${server_pid}"
+    wait "${server_pid}" 2>/dev/null || true
+done
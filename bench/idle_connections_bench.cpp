@@ -0,0 +1,240 @@
+// Opens many WebSocket connections, completes the handshake on each and then
+// keeps them idle, the way spectators sit on the game state broadcast: they
+// send nothing but the pongs to the server's idle pings. With
+// --server-pid the server's resident memory is sampled before and after, so
+// the growth per idle connection can be compared with what the server itself
+// reports in its connection stats log line.
+//
+//   idle-connections-bench [--host 127.0.0.1] [--port 4040]
+//                          [--connections 100000] [--batch 64]
+//                          [--hold 10] [--server-pid PID]
+//
+// Loopback has about 28k ephemeral ports per source address, so connections
+// are spread over the source addresses 127.0.0.1, 127.0.0.2, ... The process
+// needs an open file limit above --connections.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int CONNECTIONS_PER_SOURCE = 20000;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 4040;
+    int connections = 100000;
+    int batch = 64;
+    int hold = 10;
+    int server_pid = 0;
+};
+
+struct Connection {
+    int fd = -1;
+    bool upgraded = false;
+    std::string inbox;
+};
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") options.host = value;
+        else if (key == "--port") options.port = std::stoi(value);
+        else if (key == "--connections") options.connections = std::stoi(value);
+        else if (key == "--batch") options.batch = std::max(1, std::stoi(value));
+        else if (key == "--hold") options.hold = std::stoi(value);
+        else if (key == "--server-pid") options.server_pid = std::stoi(value);
+        else {
+            std::cerr << "unknown option " << key << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+// VmRSS of a process in bytes
+long long resident_bytes(int pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) {
+            return std::atoll(line.c_str() + 6) * 1024;
+        }
+    }
+    return 0;
+}
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int connect_to(const Options& options, int index) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) return -1;
+
+    struct sockaddr_in source;
+    std::memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(0x7f000001 + index / CONNECTIONS_PER_SOURCE);
+    int one = 1;
+    // the port is picked at connect, per destination, instead of at bind
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+    bind(fd, reinterpret_cast<struct sockaddr*>(&source), sizeof(source));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = inet_addr(options.host.c_str());
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The server pings unmasked and without payload, two bytes per ping.
+int answer_pings(int fd, const char* data, ssize_t size) {
+    static const std::string pong("\x8a\x80\x00\x00\x00\x00", 6);
+    int answered = 0;
+    for (ssize_t offset = 0; offset + 1 < size; offset += 2) {
+        if (static_cast<unsigned char>(data[offset]) != 0x89) continue;
+        send_all(fd, pong);
+        ++answered;
+    }
+    return answered;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    const std::string handshake =
+        "GET /ws HTTP/1.1\r\n"
+        "Host: " + options.host + "\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur < static_cast<rlim_t>(options.connections) + 16) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, options.connections + 16);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    long long rss_before = options.server_pid ? resident_bytes(options.server_pid) : 0;
+    auto started = Clock::now();
+    std::uint64_t pongs = 0;
+
+    // connected and upgraded a batch at a time, so neither the listener's
+    // backlog nor the server's handshake admission queue overflows
+    int epoll_fd = epoll_create1(0);
+    std::vector<Connection> connections(options.connections);
+    std::vector<struct epoll_event> events(options.batch);
+    char buffer[4096];
+    for (int first = 0; first < options.connections; first += options.batch) {
+        int last = std::min(options.connections, first + options.batch);
+        for (int i = first; i < last; ++i) {
+            Connection& connection = connections[i];
+            connection.fd = connect_to(options, i);
+            if (connection.fd == -1 || !send_all(connection.fd, handshake)) {
+                std::cerr << "failed to open connection " << i << ": " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = &connection;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &ev);
+        }
+
+        int pending = last - first;
+        while (pending > 0) {
+            int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 5000);
+            if (n == 0) {
+                std::cerr << pending << " handshakes timed out" << std::endl;
+                return 1;
+            }
+            for (int i = 0; i < n; ++i) {
+                auto* connection = static_cast<Connection*>(events[i].data.ptr);
+                ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    std::cerr << "server closed a connection during setup" << std::endl;
+                    return 1;
+                }
+                if (connection->upgraded) {
+                    pongs += answer_pings(connection->fd, buffer, received);
+                    continue;
+                }
+                connection->inbox.append(buffer, static_cast<std::size_t>(received));
+                if (connection->inbox.find("\r\n\r\n") == std::string::npos) continue;
+                std::string().swap(connection->inbox);
+                connection->upgraded = true;
+                --pending;
+            }
+        }
+    }
+
+    double setup = std::chrono::duration<double>(Clock::now() - started).count();
+    auto deadline = Clock::now() + std::chrono::seconds(options.hold);
+    while (Clock::now() < deadline) {
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < n; ++i) {
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                std::cerr << "server closed an idle connection" << std::endl;
+                return 1;
+            }
+            pongs += answer_pings(connection->fd, buffer, received);
+        }
+    }
+
+    std::printf("connections     %d\n", options.connections);
+    std::printf("setup           %.1f s\n", setup);
+    std::printf("pongs           %llu\n", static_cast<unsigned long long>(pongs));
+    if (options.server_pid) {
+        long long rss_after = resident_bytes(options.server_pid);
+        long long grown = rss_after - rss_before;
+        std::printf("server rss      %.1f MiB -> %.1f MiB\n", rss_before / 1048576.0, rss_after / 1048576.0);
+        std::printf("rss per idle    %lld bytes\n", grown / std::max(1, options.connections));
+    }
+
+    for (auto& connection : connections) close(connection.fd);
+    close(epoll_fd);
+    return 0;
+}
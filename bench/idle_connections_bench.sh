@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Holds many idle WebSocket connections against a fresh server and reports
+# how much resident memory each one costs it.
+# Usage: bench/idle_connections_bench.sh [connections] [backend]
+set -euo pipefail
+
+project_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+build_dir="${project_dir}/build/bench"
+connections="${1:-100000}"
+backend="${2:-epoll}"
+
+cmake -S "${project_dir}" -B "${build_dir}" -DCMAKE_BUILD_TYPE=Release -DWORDLE_BUILD_BENCHMARKS=ON
+cmake --build "${build_dir}" --target wordle-server idle-connections-bench
+
+# both ends hold one descriptor per connection
+ulimit -n "$(ulimit -Hn)"
+
+run_dir="$(mktemp -d)"
+trap 'rm -rf "${run_dir}"' EXIT
+
+cat > "${run_dir}/conf.json" <<CONF
+{
+    "http_port": "18080",
+    "websocket_port": "14040",
+    "address": "127.0.0.1",
+    "io_backend": "${backend}",
+    "websocket_timeout": "5",
+    "connection_stats_interval": "5",
+    "debug": "false",
+    "info": "true",
+    "warn": "true",
+    "error": "true",
+    "mock": "false"
+}
+CONF
+(cd "${run_dir}" && exec "${build_dir}/wordle-server" | grep --line-buffered "WebSocket connections") &
+sleep 1
+server_pid="$(pgrep -n -x wordle-server)"
+
+# held past the idle timeout, so the server has pinged every connection
+# and released the buffers of the idle ones
+"${build_dir}/idle-connections-bench" --port 14040 --connections "${connections}" \
+    --hold 15 --server-pid "${server_pid}" || true
+
+kill "${server_pid}"
+wait 2>/dev/null || true
@@ -0,0 +1,215 @@
+// WebSocket echo load generator used to compare the epoll and io_uring
+// backends of TcpServer on the same workload. Every connection keeps one
+// small masked text frame in flight and sends the next one as soon as the
+// echo is back, so the server sees a steady stream of tiny reads and writes.
+//
+//   io-backend-bench [--host 127.0.0.1] [--port 4040] [--connections 64]
+//                    [--seconds 10] [--payload 32] [--server-pid PID]
+//
+// With --server-pid the server's CPU time over the run is read from /proc
+// and reported per echoed message, which is the number the backends differ in.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 4040;
+    int connections = 64;
+    int seconds = 10;
+    std::size_t payload = 32;
+    int server_pid = 0;
+};
+
+struct Connection {
+    int fd = -1;
+    bool upgraded = false;
+    std::string inbox;
+    Clock::time_point sent_at;
+};
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if (key == "--host") options.host = value;
+        else if (key == "--port") options.port = std::stoi(value);
+        else if (key == "--connections") options.connections = std::stoi(value);
+        else if (key == "--seconds") options.seconds = std::stoi(value);
+        else if (key == "--payload") options.payload = std::min<std::size_t>(std::stoul(value), 125);
+        else if (key == "--server-pid") options.server_pid = std::stoi(value);
+        else {
+            std::cerr << "unknown option " << key << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+// utime + stime of a process in seconds
+double process_cpu_seconds(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return 0;
+    // fields after the parenthesised command name, which may contain spaces
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for (int index = 3; fields >> field; ++index) {
+        if (index == 14) utime = std::stoull(field);
+        if (index == 15) {
+            stime = std::stoull(field);
+            break;
+        }
+    }
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+std::string masked_text_frame(const std::string& payload) {
+    const unsigned char mask[4] = {0x12, 0x34, 0x56, 0x78};
+    std::string frame;
+    frame.push_back(static_cast<char>(0x81));
+    frame.push_back(static_cast<char>(0x80 | payload.size()));
+    frame.append(reinterpret_cast<const char*>(mask), 4);
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+        frame.push_back(static_cast<char>(payload[i] ^ mask[i % 4]));
+    }
+    return frame;
+}
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int connect_to(const Options& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = inet_addr(options.host.c_str());
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+    const std::string handshake =
+        "GET /ws HTTP/1.1\r\n"
+        "Host: " + options.host + "\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    const std::string frame = masked_text_frame(std::string(options.payload, 'x'));
+    // unmasked echo: two header bytes and the payload
+    const std::size_t echo_size = 2 + options.payload;
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<Connection> connections(options.connections);
+    for (auto& connection : connections) {
+        connection.fd = connect_to(options);
+        if (connection.fd == -1 || !send_all(connection.fd, handshake)) {
+            std::cerr << "failed to connect to " << options.host << ":" << options.port << std::endl;
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &ev);
+    }
+
+    std::uint64_t echoed = 0;
+    double latency_total_us = 0;
+    double cpu_before = options.server_pid ? process_cpu_seconds(options.server_pid) : 0;
+    auto started = Clock::now();
+    auto deadline = started + std::chrono::seconds(options.seconds);
+    std::vector<struct epoll_event> events(options.connections);
+    char buffer[4096];
+
+    while (Clock::now() < deadline) {
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < n; ++i) {
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                std::cerr << "server closed a connection" << std::endl;
+                return 1;
+            }
+            connection->inbox.append(buffer, static_cast<std::size_t>(received));
+
+            if (!connection->upgraded) {
+                auto end = connection->inbox.find("\r\n\r\n");
+                if (end == std::string::npos) continue;
+                connection->inbox.erase(0, end + 4);
+                connection->upgraded = true;
+            } else if (connection->inbox.size() >= echo_size) {
+                connection->inbox.erase(0, echo_size);
+                ++echoed;
+                latency_total_us += std::chrono::duration<double, std::micro>(
+                    Clock::now() - connection->sent_at).count();
+            } else {
+                continue;
+            }
+            connection->sent_at = Clock::now();
+            if (!send_all(connection->fd, frame)) {
+                std::cerr << "failed to send frame" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+    std::printf("connections     %d\n", options.connections);
+    std::printf("payload         %zu bytes\n", options.payload);
+    std::printf("echoes          %llu\n", static_cast<unsigned long long>(echoed));
+    std::printf("throughput      %.0f msg/s\n", echoed / elapsed);
+    std::printf("mean rtt        %.1f us\n", echoed ? latency_total_us / echoed : 0.0);
+    if (options.server_pid) {
+        double cpu = process_cpu_seconds(options.server_pid) - cpu_before;
+        std::printf("server cpu      %.2f s (%.1f%% of one core)\n", cpu, 100.0 * cpu / elapsed);
+        std::printf("cpu per message %.2f us\n", echoed ? cpu * 1e6 / echoed : 0.0);
+    }
+
+    for (auto& connection : connections) close(connection.fd);
+    close(epoll_fd);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# Runs the WebSocket echo benchmark against the server once per io backend.
+# Usage: bench/io_backend_bench.sh [connections] [seconds]
+set -euo pipefail
+
+project_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+build_dir="${project_dir}/build/bench"
+connections="${1:-64}"
+seconds="${2:-10}"
+
+cmake -S "${project_dir}" -B "${build_dir}" -DCMAKE_BUILD_TYPE=Release -DWORDLE_BUILD_BENCHMARKS=ON
+cmake --build "${build_dir}" --target wordle-server io-backend-bench
+
+run_dir="$(mktemp -d)"
+trap 'rm -rf "${run_dir}"' EXIT
+
+for backend in epoll io_uring; do
+    cat > "${run_dir}/conf.json" <<CONF
+{
+    "http_port": "18080",
+    "websocket_port": "14040",
+    "address": "127.0.0.1",
+    "io_backend": "${backend}",
+    "debug": "false",
+    "info": "false",
+    "warn": "true",
+    "error": "true",
+    "mock": "false"
+}
+CONF
+    (cd "${run_dir}" && exec "${build_dir}/wordle-server") &
+    server_pid=$!
+    sleep 1
+
+    echo "== ${backend}"
+    "${build_dir}/io-backend-bench" --port 14040 --connections "${connections}" \
+        --seconds "${seconds}" --server-pid "${server_pid}" || true
+
+    kill "${server_pid}"
+    wait "${server_pid}" 2>/dev/null || true
+done
@@ -11,8 +11,21 @@ import type { GameState } from '../types';
 
 const DEFAULT_WS_URL = import.meta.env.VITE_WS_URL || 'ws://0.0.0.0:4040';
 const RECONNECT_DELAY = 3000; // 3 seconds
+const MAX_RECONNECT_DELAY = 30000; // 30 seconds
 const MAX_RECONNECT_ATTEMPTS = 10;
 
+/**
+ * Delay before the given reconnect attempt: doubling from the base delay,
+ * randomized between half and all of it. After a server restart every
+ * client reconnects at once; the jitter spreads them out instead of having
+ * them retry in lockstep, and the server turns away handshakes it has no
+ * room for.
+ */
+const reconnectDelayFor = (attempt: number, baseDelay: number): number => {
+  const delay = Math.min(baseDelay * 2 ** (attempt - 1), MAX_RECONNECT_DELAY);
+  return Math.round(delay / 2 + Math.random() * (delay / 2));
+};
+
 interface UseGameWebSocketConfig {
   wsUrl?: string;
   autoConnect?: boolean;
@@ -196,13 +209,14 @@ export const useGameWebSocket = (
       setReconnectAttempts(reconnectAttemptsRef.current);
       setConnectionStatus('reconnecting');
       
+      const delay = reconnectDelayFor(reconnectAttemptsRef.current, reconnectDelay);
       console.log(
-        `[WebSocket] Reconnecting in ${reconnectDelay}ms... (Attempt ${reconnectAttemptsRef.current}/${maxReconnectAttempts})`
+        `[WebSocket] Reconnecting in ${delay}ms... (Attempt ${reconnectAttemptsRef.current}/${maxReconnectAttempts})`
       );
       
       reconnectTimeoutRef.current = setTimeout(() => {
         connectWebSocket();
-      }, reconnectDelay);
+      }, delay);
     } else if (reconnectAttemptsRef.current >= maxReconnectAttempts) {
       console.error('[WebSocket] Max reconnection attempts reached');
       setConnectionStatus('error');
@@ -5,14 +5,29 @@
 #include "server/web-socket/web_socket_pool.h"
 #include "server/cron/cron.h"
 #include "server/utils/logger.h"
+#include <chrono>
+#include <mutex>
+#include <string>
 
 GameState game_state = GameState(120);
 
+// Handlers run concurrently on every reactor, and the cron thread mutates
+// the same state, so every access to game_state goes through this lock.
+static std::mutex game_state_mutex;
+// set once the state is handed to a new process, see freeze_game_state
+static bool frozen = false;
+
+static Result<nlohmann::json> frozen_error() {
+    return Result<nlohmann::json>(Error("Handing off to a new process", HttpStatusCode::SERVICE_UNAVAILABLE));
+}
+
 void set_game_state_cron() {
     Cron& cron = Cron::instance();
     cron.add_job(
         "round_finish", 
         []() {
+            std::lock_guard<std::mutex> lock(game_state_mutex);
+            if (frozen) return;
             Logger::instance().info("Round finished");
             game_state.next_round();
             nlohmann::json json = game_state;
@@ -22,6 +37,8 @@ void set_game_state_cron() {
    .add_job(
     "vote_end",
     []() {
+        std::lock_guard<std::mutex> lock(game_state_mutex);
+        if (frozen) return;
         game_state.end_vote();
         nlohmann::json json = game_state;
         WebSocketPool::instance().broadcast_all(json);
@@ -29,8 +46,28 @@ void set_game_state_cron() {
     std::chrono::seconds(60), Cron::JobMode::OFF);
 };
 
+nlohmann::json freeze_game_state() {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    frozen = true;
+    return game_state.snapshot();
+}
+
+void thaw_game_state() {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    frozen = false;
+    // a round or vote that ended in the meantime ends now
+    game_state.resume_timers();
+}
+
+void restore_game_state(const nlohmann::json& snapshot) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    game_state.restore(snapshot);
+}
+
 ServerMethod join_method = ServerMethod<JoinRequest>("/join", HttpMethod::POST, 
 [](const JoinRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    if (frozen) return frozen_error();
     //gracz wchodzi do gry wchodzi do poczekalni jesli jego nick jest juz zajety to zwraca error
 
     auto result = game_state.add_player(request);
@@ -47,6 +84,8 @@ ServerMethod join_method = ServerMethod<JoinRequest>("/join", HttpMethod::POST,
 
 ServerMethod leave_method = ServerMethod<JoinRequest>("/leave", HttpMethod::DELETE, 
 [](const JoinRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    if (frozen) return frozen_error();
     auto result = game_state.remove_player(request);
     if (result.is_err()) {
         return Result<nlohmann::json>(result.unwrap_err());
@@ -59,6 +98,8 @@ ServerMethod leave_method = ServerMethod<JoinRequest>("/leave", HttpMethod::DELE
 
 ServerMethod ready_method = ServerMethod<StateRequest>("/ready", HttpMethod::POST,
 [](const StateRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    if (frozen) return frozen_error();
     // ustaw gracza jako READY w lobby
     auto result = game_state.set_ready(request);
 
@@ -69,20 +110,36 @@ ServerMethod ready_method = ServerMethod<StateRequest>("/ready", HttpMethod::POS
     nlohmann::json json = game_state;
     WebSocketPool::instance().broadcast_all(json);
     return Result<nlohmann::json>(json);
-});
+}, Priority::HIGH);
 
 
+// Versions restart with the process, so the tag carries its start time too;
+// a tag from an earlier process never matches.
+static const std::string state_epoch =
+    std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+
+static std::string state_etag() {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    return "\"" + state_epoch + "-" + std::to_string(game_state.get_version()) + "\"";
+}
+
+// Polled by every client, so a poll that finds nothing new gets a 304.
 ServerMethod state_method = ServerMethod<StateRequest>("/", HttpMethod::GET, 
 [](const StateRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
     // pobiera stan gry dostepny dla gracza zwraca error jesli gracz nie jest w grze
     nlohmann::json json = game_state;
     // return Result<nlohmann::json>(json);
 
     return Result<nlohmann::json>(game_state);
-});
+}).with_etag(state_etag);
 
+// The guess's timestamp has to land inside the round, so guesses, like the
+// other in-game actions, are handled ahead of state polls.
 ServerMethod guess_method = ServerMethod<GuessRequest>("/guess", HttpMethod::POST,
 [](const GuessRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    if (frozen) return frozen_error();
     auto result = game_state.make_guess(request);
     if (result.is_err()) return Result<nlohmann::json>(result.unwrap_err());
 
@@ -92,10 +149,12 @@ ServerMethod guess_method = ServerMethod<GuessRequest>("/guess", HttpMethod::POS
     json["guess_result"] = result.unwrap();  //tablica WordleWord
     WebSocketPool::instance().broadcast_all(json);
     return Result<nlohmann::json>(json);
-});
+}, Priority::HIGH);
 
 ServerMethod vote_method = ServerMethod<VoteRequest>("/vote", HttpMethod::POST,
 [](const VoteRequest& request) {
+    std::lock_guard<std::mutex> lock(game_state_mutex);
+    if (frozen) return frozen_error();
     
     auto result = game_state.vote(
         request.voting_player,
@@ -106,5 +165,5 @@ ServerMethod vote_method = ServerMethod<VoteRequest>("/vote", HttpMethod::POST,
     nlohmann::json json = game_state;
     WebSocketPool::instance().broadcast_all(json);
     return Result<nlohmann::json>(json);
-});
+}, Priority::HIGH);
 
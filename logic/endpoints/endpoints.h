@@ -6,6 +6,13 @@
 #include "server/cron/cron.h"
 
 extern void set_game_state_cron();
+// Used to carry the game over to a new process on a binary upgrade. Taking
+// the snapshot freezes the game here: changes are refused with 503 and the
+// round and vote timers do nothing, so nothing happens that the new process
+// does not know of. thaw_game_state undoes it when the handoff fails.
+extern nlohmann::json freeze_game_state();
+extern void thaw_game_state();
+extern void restore_game_state(const nlohmann::json& snapshot);
 
 extern ServerMethod<JoinRequest> join_method;
 extern ServerMethod<StateRequest> state_method;
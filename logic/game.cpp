@@ -146,3 +146,26 @@ Result<std::vector<WordleWord>> Game::make_guess(const std::string& player_name,
 }
 
 
+nlohmann::json Game::snapshot() const {
+    nlohmann::json json = *this;
+    json["rounds"] = nlohmann::json::array();
+    for (const auto& round : rounds) {
+        json["rounds"].push_back(round.snapshot());
+    }
+    return json;
+}
+
+void Game::restore(const nlohmann::json& snapshot) {
+    snapshot.at("round_end_time").get_to(round_end_time);
+    snapshot.at("round_duration").get_to(round_duration);
+    snapshot.at("game_start_time").get_to(game_start_time);
+    snapshot.at("players_list").get_to(players_list);
+
+    // rundy trzymają wskaźniki na graczy, więc odtwarzamy je dopiero po players_list
+    rounds.clear();
+    for (const auto& round_snapshot : snapshot.at("rounds")) {
+        Round round(std::vector<Player*>(), round_duration);
+        round.restore(round_snapshot, players_list);
+        rounds.push_back(std::move(round));
+    }
+}
@@ -53,6 +53,10 @@ public:
 
     int get_round() const;
 
+    // Stan gry z pełnym stanem rund, do przekazania nowemu procesowi
+    nlohmann::json snapshot() const;
+    void restore(const nlohmann::json& snapshot);
+
     // Gracz wysyła guess: Game przekazuje to do aktualnej rundy
     Result<std::vector<WordleWord>> make_guess(const std::string& player_name,
                                           const std::string& guess,
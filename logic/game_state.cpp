@@ -31,6 +31,7 @@ Result<GameState> GameState::add_player(const JoinRequest& request) {
         }
     }
     players_list.emplace_back(player_name);
+    bump_version();
 
 
     // // dodaj do lobby
@@ -81,6 +82,7 @@ Result<GameState> GameState::vote(std::string voting_player, std::string voted_p
     } else {
         current_vote->vote_against(voting_player);
     }
+    bump_version();
 
     if(current_vote->is_vote_ended(players_list.size())) {
         Cron::instance().set_job_settings(
@@ -106,7 +108,7 @@ void GameState::end_vote() {
     }
     current_vote.reset();
     vote_end_time = 0;
-
+    bump_version();
 }
 
 Result<GameState> GameState::remove_player(const JoinRequest& request) {
@@ -115,6 +117,7 @@ Result<GameState> GameState::remove_player(const JoinRequest& request) {
     for (auto it = players_list.begin(); it != players_list.end(); ++it) {
         if (it->player_name == player_name) {
             players_list.erase(it);
+            bump_version();
             return Result<GameState>(*this);
         }
     }
@@ -124,6 +127,7 @@ Result<GameState> GameState::remove_player(const JoinRequest& request) {
 void GameState::next_round() {
     if (!game.has_value()) return;
 
+    bump_version();
     const bool next_started = game->end_round();
     if (!next_started) {
         end_game();   // <- PRZERZUT DO LOBBY
@@ -147,6 +151,7 @@ bool GameState::start_game() {
 
     game_start_time = std::time(nullptr);
     round_end_time = game_start_time + round_duration;
+    bump_version();
 
     // przerzucamy lobby do gry (po starcie lobby ma być puste)
     game = Game(std::move(players_list), round_duration);
@@ -203,6 +208,7 @@ void GameState::end_game() {
     game.reset();
     round_end_time = 0;
     game_start_time = 0;
+    bump_version();
 }
 
 
@@ -225,6 +231,7 @@ Result<std::vector<WordleWord>> GameState::make_guess(const GuessRequest& reques
         request.timestamp
     );
     if (guess_result.is_err()) return guess_result.unwrap_err();
+    bump_version();
 
     if(game->check_if_game_is_over()) {
         end_game();
@@ -235,6 +242,14 @@ Result<std::vector<WordleWord>> GameState::make_guess(const GuessRequest& reques
 
 
 
+std::uint64_t GameState::get_version() const {
+    return version;
+}
+
+void GameState::bump_version() {
+    ++version;
+}
+
 bool GameState::all_ready_in_lobby() const {
     if (players_list.empty()) return false;
 
@@ -258,6 +273,7 @@ Result<GameState> GameState::set_ready(const StateRequest& request) {
         Player& p = players_list[i];
         if (p.player_name == player_name) {
             p.set_is_ready(true);
+            bump_version();
 
             // jeśli wszyscy gotowi i jest min. liczba graczy -> start gry
             const size_t MIN_PLAYERS = 3;
@@ -271,3 +287,50 @@ Result<GameState> GameState::set_ready(const StateRequest& request) {
 
     return Error("Player not found in lobby", HttpStatusCode::NOT_FOUND);
 }
+
+
+nlohmann::json GameState::snapshot() const {
+    nlohmann::json json = *this;
+    json["game"] = game.has_value() ? game->snapshot() : nlohmann::json(nullptr);
+    return json;
+}
+
+void GameState::restore(const nlohmann::json& snapshot) {
+    snapshot.at("round_end_time").get_to(round_end_time);
+    snapshot.at("round_duration").get_to(round_duration);
+    snapshot.at("game_start_time").get_to(game_start_time);
+    snapshot.at("players_list").get_to(players_list);
+    snapshot.at("vote_duration").get_to(vote_duration);
+    snapshot.at("vote_end_time").get_to(vote_end_time);
+    current_vote.reset();
+    if (!snapshot.at("current_vote").is_null()) {
+        current_vote = snapshot.at("current_vote").get<Vote>();
+    }
+
+    game.reset();
+    if (!snapshot.at("game").is_null()) {
+        game.emplace(std::vector<Player>(), round_duration);
+        game->restore(snapshot.at("game"));
+    }
+    bump_version();
+    resume_timers();
+}
+
+static void resume_job(const std::string& identifier, time_t remaining, time_t interval) {
+    Cron& cron = Cron::instance();
+    // next_run liczy się z aktualnego interwału, potem wracamy do pełnego
+    cron.set_job_interval(identifier, std::chrono::seconds(std::max<time_t>(remaining, 0)));
+    cron.reset_job_next_run(identifier);
+    cron.set_job_interval(identifier, std::chrono::seconds(interval));
+    cron.set_job_mode(identifier, Cron::JobMode::ONCE);
+}
+
+void GameState::resume_timers() {
+    const time_t now = std::time(nullptr);
+    if (game.has_value()) {
+        resume_job("round_finish", round_end_time - now, round_duration);
+    }
+    if (current_vote.has_value()) {
+        resume_job("vote_end", vote_end_time - now, vote_duration);
+    }
+}
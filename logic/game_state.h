@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <ctime>
@@ -36,10 +37,16 @@ private:
     // VOTE TIMER
     time_t vote_duration;  // ile trwa głosowanie (sekundy)
     time_t vote_end_time;  // kiedy kończy się głosowanie (unix time)
+
+    // Rośnie przy każdej zmianie stanu; nie jest częścią JSON-a
+    std::uint64_t version = 0;
+    void bump_version();
     
 public:
     Result<GameState> set_ready(const StateRequest& request);
     bool all_ready_in_lobby() const;
+    // Wersja stanu, do ETag-ów odpowiedzi z pełnym stanem
+    std::uint64_t get_version() const;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(
         GameState,
@@ -78,6 +85,13 @@ public:
     //Result<std::vector<WordleWord>> make_guess(const GuessRequest& request);//ta metoda przekazuje guess do aktualnej rundy
     Result<std::vector<WordleWord>> make_guess(const GuessRequest& request);
 
+    // Pełny stan (razem z próbami graczy w rundach) do przekazania nowemu
+    // procesowi przy podmianie binarki i jego odtworzenie po drugiej stronie
+    nlohmann::json snapshot() const;
+    void restore(const nlohmann::json& snapshot);
+    // Ustawia zadania crona na czas pozostały do końca rundy i głosowania
+    void resume_timers();
+
 
 
 
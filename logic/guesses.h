@@ -5,6 +5,7 @@
 
 #include "server/utils/result.h"
 #include "wordle_word.h"
+#include "nlohmann/json.hpp"
 
 enum class GuessResult {
     INCORRECT,
@@ -17,7 +18,9 @@ private:
     int max_guesses;
 
 public:
-    Guesses(int max_guesses);
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(Guesses, guesses, max_guesses);
+
+    Guesses(int max_guesses = 6);
 
     // Dodaje próbę i koloruje litery na podstawie actual
     Result<WordleWord> add_guess_word(const std::string& guess, const std::string& actual);
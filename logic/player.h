@@ -31,7 +31,7 @@ private:
 public:
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(Player, player_name, round_errors, all_errors, is_alive, is_ready);
 
-    Player(const std::string& name);
+    Player(const std::string& name = "");
 
     // Reset gracza do stanu początkowego
     void reset_state();
@@ -1,4 +1,5 @@
 #include "round.h"
+#include <algorithm>
 #include <random>
 
 static std::string pick_random_word() {
@@ -152,4 +153,28 @@ void Round::finalize_round() {
             player->is_alive = false;
         }
     }
-}
\ No newline at end of file
+}
+
+nlohmann::json Round::snapshot() const {
+    nlohmann::json json = *this;
+    nlohmann::json guesses = nlohmann::json::object();
+    for (const auto& [player, player_guesses] : players_map) {
+        if (!player) continue;
+        guesses[player->player_name] = player_guesses;
+    }
+    json["guesses"] = guesses;
+    return json;
+}
+
+void Round::restore(const nlohmann::json& snapshot, std::vector<Player>& players) {
+    snapshot.get_to(*this);
+
+    players_map.clear();
+    for (const auto& [player_name, guesses] : snapshot.at("guesses").items()) {
+        auto it = std::find_if(players.begin(), players.end(), [&](const Player& p) {
+            return p.player_name == player_name;
+        });
+        if (it == players.end()) continue;
+        players_map.emplace(&*it, guesses.get<Guesses>());
+    }
+}
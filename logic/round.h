@@ -41,4 +41,10 @@ public:
 
     void finalize_round();
 
+    // Pełny stan rundy razem z próbami graczy (kluczowanymi nazwą gracza),
+    // których nie ma w zwykłym jsonie wysyłanym klientom
+    nlohmann::json snapshot() const;
+    // players to lista, na którą wskazują odtworzone wskaźniki w players_map
+    void restore(const nlohmann::json& snapshot, std::vector<Player>& players);
+
 };
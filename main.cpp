@@ -11,17 +11,254 @@
 #include "server/web-socket/web_socket_server.h"
 #include "server/cron/cron.h"
 #include "logic/endpoints/endpoints.h"
+#include "server/server/handoff.h"
+#include "server/server/tls_context.h"
+#include <atomic>
+#include <optional>
+#include <sstream>
+#include <unordered_set>
 using namespace std;
 
 
 
 
-void keep_alive() {
-    while (true) {
+void keep_alive(const std::atomic<bool>& handed_off) {
+    while (!handed_off) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
 }
 
+// Holds new connections back in the listeners' backlogs and takes every
+// WebSocket connection off the loops. HTTP connections stay behind and are
+// drained by this process; from the snapshot on it refuses changes to the
+// game and closes each connection after its next response.
+Handoff::Payload prepare_handoff(HttpServer& http_server, WebSocketServer& web_socket_server,
+                                 const std::shared_ptr<TlsContext>& tls) {
+    http_server.pause_accepting();
+    web_socket_server.pause_accepting();
+
+    Handoff::Payload payload;
+    payload.servers.push_back(Handoff::ServerState{http_server.get_listener_fds(), {}});
+    Handoff::ServerState web_socket_state{web_socket_server.get_listener_fds(), {}};
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (true) {
+        bool force = std::chrono::steady_clock::now() >= deadline;
+        std::size_t remaining = 0;
+        for (auto& connection : web_socket_server.detach_connections(force, remaining)) {
+            web_socket_state.connections.push_back(std::move(connection));
+        }
+        if (remaining == 0) break;
+        if (force) {
+            Logger::instance().warn(std::to_string(remaining) + " busy WebSocket connections stay behind");
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    payload.servers.push_back(std::move(web_socket_state));
+    http_server.set_handing_off(true);
+    payload.state = freeze_game_state();
+    if (tls) payload.tls_ticket_keys = tls->get_ticket_keys();
+    return payload;
+}
+
+void resume_after_failed_handoff(HttpServer& http_server, WebSocketServer& web_socket_server, Handoff::Payload& payload) {
+    thaw_game_state();
+    http_server.set_handing_off(false);
+    web_socket_server.cancel_detach();
+    for (auto& connection : payload.servers[1].connections) {
+        web_socket_server.adopt_connection(std::move(connection));
+    }
+    http_server.resume_accepting();
+    web_socket_server.resume_accepting();
+}
+
+void log_connection_stats(const std::string& name, TcpServer& server) {
+    auto stats = server.get_connection_stats();
+    std::string per_connection = stats.connections == 0
+        ? "-"
+        : std::to_string(stats.bytes / stats.connections);
+    Logger::instance().info(
+        name + " connections: " + std::to_string(stats.connections) + ", " +
+        std::to_string(stats.bytes) + " bytes, " + per_connection + " bytes per connection"
+    );
+}
+
+void log_limit_stats(const std::string& name, TcpServer& server) {
+    auto stats = server.get_limit_stats();
+    Logger::instance().info(
+        name + " limits hit: header " + std::to_string(stats.header_too_large) +
+        ", body " + std::to_string(stats.body_too_large) +
+        ", frame " + std::to_string(stats.frame_too_large) +
+        ", output " + std::to_string(stats.output_too_large) +
+        ", too slow " + std::to_string(stats.too_slow)
+    );
+}
+
+void log_admission_stats(const std::string& name, TcpServer& server) {
+    auto stats = server.get_admission_stats();
+    Logger::instance().info(
+        name + " admissions: " + std::to_string(stats.delayed) + " delayed, " +
+        std::to_string(stats.refused) + " refused"
+    );
+}
+
+void log_overload_stats(const std::string& name, TcpServer& server) {
+    auto stats = server.get_overload_stats();
+    Logger::instance().info(
+        name + " load: " + (stats.overloaded ? "overloaded" : "normal") +
+        ", loop lag " + std::to_string(stats.loop_lag.count()) + "us" +
+        ", queue depth " + std::to_string(stats.queue_depth) +
+        ", " + std::to_string(stats.episodes) + " overload episodes, " +
+        std::to_string(stats.shed) + " requests shed"
+    );
+}
+
+void log_lane_stats(const std::string& name, TcpServer& server) {
+    auto lanes = server.get_lane_stats();
+    std::string line = name + " pool lanes:";
+    for (std::size_t i = 0; i < PRIORITY_COUNT; ++i) {
+        const auto& lane = lanes[i];
+        line += std::string(i == 0 ? " " : ", ") + priority_to_string(static_cast<Priority>(i)) + " " +
+                std::to_string(lane.queue_depth) + " queued, " + std::to_string(lane.executed) + " run, " +
+                "wait " + std::to_string(lane.wait.count()) + "us (max " + std::to_string(lane.max_wait.count()) + "us)";
+    }
+    Logger::instance().info(line);
+}
+
+void log_zerocopy_stats(const std::string& name, TcpServer& server) {
+    auto stats = server.get_zerocopy_stats();
+    Logger::instance().info(
+        name + " zerocopy sends: " + std::to_string(stats.completed) + " completed, " +
+        std::to_string(stats.copied) + " copied by the kernel"
+    );
+}
+
+void log_tls_stats(const TlsContext& tls) {
+    auto stats = tls.get_stats();
+    Logger::instance().info(
+        "TLS handshakes: " + std::to_string(stats.handshakes) + ", " +
+        std::to_string(stats.resumed) + " resumed, " +
+        std::to_string(stats.ktls_send) + " with kernel TLS"
+    );
+}
+
+void log_compression_stats(const HttpServer& server) {
+    auto stats = server.get_compression_stats();
+    Logger::instance().info(
+        "HTTP compressed bodies: " + std::to_string(stats.compressed) + ", " +
+        std::to_string(stats.cached) + " from the cache, " +
+        std::to_string(stats.bytes_in) + " bytes down to " + std::to_string(stats.bytes_out)
+    );
+}
+
+HttpCompression::Options load_compression(Config& config) {
+    HttpCompression::Options options;
+    options.level = std::stoi(config.get_config("compression_level").value_or("6"));
+    options.min_size = std::stoul(config.get_config("compression_min_size").value_or("1024"));
+    return options;
+}
+
+TcpServer::OverloadPolicy load_overload_policy(Config& config) {
+    TcpServer::OverloadPolicy policy;
+    policy.max_loop_lag = std::chrono::milliseconds(
+        std::stoi(config.get_config("overload_max_loop_lag_ms").value_or("50"))
+    );
+    policy.max_queue_depth = std::stoul(config.get_config("overload_max_queue_depth").value_or("1000"));
+    policy.retry_after = std::chrono::seconds(
+        std::stoi(config.get_config("overload_retry_after").value_or("2"))
+    );
+    return policy;
+}
+
+// comma separated
+std::unordered_set<std::string> load_critical_paths(Config& config) {
+    std::unordered_set<std::string> paths;
+    std::istringstream list(config.get_config("critical_paths").value_or("/guess,/ready"));
+    std::string path;
+    while (std::getline(list, path, ',')) {
+        if (!path.empty()) paths.insert(path);
+    }
+    return paths;
+}
+
+// From the "listeners.<name>" section; an empty value keeps the kernel default.
+SocketOptions load_socket_options(Config& config, const std::string& name) {
+    auto number = [&](const std::string& key) -> std::optional<int> {
+        std::string value = config.get_config("listeners." + name + "." + key).value_or("");
+        if (value.empty()) return std::nullopt;
+        return std::stoi(value);
+    };
+    auto flag = [&](const std::string& key) -> std::optional<bool> {
+        std::string value = config.get_config("listeners." + name + "." + key).value_or("");
+        if (value.empty()) return std::nullopt;
+        return value == "true";
+    };
+    SocketOptions options;
+    options.tcp_nodelay = flag("tcp_nodelay");
+    options.defer_accept_seconds = number("defer_accept");
+    options.fastopen_queue = number("fastopen_queue");
+    options.receive_buffer = number("receive_buffer");
+    options.send_buffer = number("send_buffer");
+    options.notsent_lowat = number("notsent_lowat");
+    options.busy_poll_us = number("busy_poll");
+    options.keepalive = flag("keepalive");
+    options.keepalive_idle_seconds = number("keepalive_idle");
+    options.keepalive_interval_seconds = number("keepalive_interval");
+    options.keepalive_probes = number("keepalive_probes");
+    return options;
+}
+
+// One context for every listener with "listeners.<name>.tls" set, so a
+// session resumes whichever server it started on; null when none has it.
+std::shared_ptr<TlsContext> load_tls(Config& config) {
+    bool wanted = config.get_config("listeners.http.tls").value_or("false") == "true" ||
+                  config.get_config("listeners.websocket.tls").value_or("false") == "true";
+    if (!wanted) return nullptr;
+
+    TlsContext::Options options;
+    options.certificate_file = config.get_config("tls.certificate").value_or("");
+    options.private_key_file = config.get_config("tls.private_key").value_or("");
+    options.session_cache_size = std::stoul(config.get_config("tls.session_cache_size").value_or("20480"));
+    options.session_lifetime = std::chrono::seconds(
+        std::stoi(config.get_config("tls.session_lifetime").value_or("7200"))
+    );
+    options.ktls = config.get_config("tls.ktls").value_or("true") == "true";
+    auto context = std::make_shared<TlsContext>();
+    // serving plaintext instead would be worse than not starting
+    context->setup(options).unwrap();
+    return context;
+}
+
+// "listeners.<name>.address" when set, e.g. unix:/run/wordle/http.sock,
+// otherwise the shared "address".
+std::string load_listener_address(Config& config, const std::string& name) {
+    std::string address = config.get_config("listeners." + name + ".address").value_or("");
+    if (!address.empty()) return address;
+    return config.get_config("address").value_or("0.0.0.0");
+}
+
+TcpServer::Limits load_limits(Config& config) {
+    TcpServer::Limits limits;
+    limits.max_header_bytes = std::stoul(config.get_config("max_header_bytes").value_or("8192"));
+    limits.max_body_bytes = std::stoul(config.get_config("max_body_bytes").value_or("65536"));
+    limits.max_frame_bytes = std::stoul(config.get_config("max_frame_bytes").value_or("65536"));
+    limits.max_output_bytes = std::stoul(config.get_config("max_output_bytes").value_or("8388608"));
+    limits.min_data_rate = std::stoul(config.get_config("min_data_rate").value_or("128"));
+    limits.data_rate_grace = std::chrono::seconds(
+        std::stoi(config.get_config("data_rate_grace").value_or("10"))
+    );
+    return limits;
+}
+
+void drain_http(HttpServer& http_server, std::chrono::seconds timeout) {
+    Logger::instance().info("Draining HTTP connections before exiting");
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (http_server.count_connections() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
 int main(int argc, char* argv[]) {
     Config& config = Config::instance();
     config.load_config();
@@ -32,26 +269,148 @@ int main(int argc, char* argv[]) {
     Cron& game_cron = Cron::instance();
     game_cron.start();
 
+    // With a previous process serving the handoff socket, its listeners,
+    // WebSocket connections and game state are taken over instead of
+    // starting empty.
+    const std::string handoff_path = config.get_config("handoff_socket").value_or("");
+    Handoff handoff(handoff_path);
+    std::optional<Handoff::Payload> inherited;
+    if (!handoff_path.empty()) {
+        auto received = handoff.receive();
+        if (received.is_ok()) {
+            inherited = received.unwrap();
+        } else {
+            Logger::instance().info(received.unwrap_err().get_message(false));
+        }
+    }
+
     HttpServer server;
+    WebSocketServer web_socket_server;
+    if (inherited.has_value()) {
+        server.adopt_listeners(inherited->servers.at(0).listeners);
+        web_socket_server.adopt_listeners(inherited->servers.at(1).listeners);
+        restore_game_state(inherited->state);
+    }
+
     server.add_method(join_method);
     server.add_method(ready_method);
     server.add_method(leave_method);
     server.add_method(state_method);
     server.add_method(guess_method);
     server.add_method(vote_method);
+    const IoBackend io_backend = config.get_config("io_backend").value_or("epoll") == "io_uring"
+        ? IoBackend::IO_URING
+        : IoBackend::EPOLL;
+
+    const TcpServer::Limits limits = load_limits(config);
+    const std::shared_ptr<TlsContext> tls = load_tls(config);
+    // competitive rounds trade a core per reactor for tail latency
+    const std::chrono::microseconds reactor_spin(
+        std::stoll(config.get_config("reactor_spin_us").value_or("0"))
+    );
+    if (tls && inherited.has_value() && !inherited->tls_ticket_keys.empty()) {
+        // tickets the previous process issued stay valid
+        tls->set_ticket_keys(inherited->tls_ticket_keys).log_error();
+    }
+    const int listen_backlog = std::stoi(config.get_config("listen_backlog").value_or("4096"));
+    const std::size_t http_reactors = std::stoul(config.get_config("http_reactors").value_or("1"));
+    server.set_reactor_count(http_reactors);
+    server.set_io_backend(io_backend);
+    server.set_busy_poll(reactor_spin);
+    server.set_limits(limits);
+    server.set_listen_backlog(listen_backlog);
+    server.set_socket_options(load_socket_options(config, "http"));
+    if (config.get_config("listeners.http.tls").value_or("false") == "true") server.set_tls(tls);
+    server.set_overload_policy(load_overload_policy(config));
+    server.set_critical_paths(load_critical_paths(config));
+    server.set_client_timeout(std::chrono::seconds(
+        std::stoi(config.get_config("http_timeout").value_or("60"))
+    ));
+    // bounds how long one client can keep a keep-alive connection busy
+    server.set_max_requests(std::stoul(config.get_config("http_max_requests").value_or("1000")));
+    server.set_compression(load_compression(config));
     server.start(
         std::stoi(config.get_config("http_port").value_or("8080")), 
-        config.get_config("address").value_or("0.0.0.0")
+        load_listener_address(config, "http")
     );
     server.run();
 
-    WebSocketServer web_socket_server;
+    web_socket_server.set_reactor_count(
+        std::stoul(config.get_config("websocket_reactors").value_or("1")),
+        static_cast<int>(http_reactors)
+    );
+    web_socket_server.set_io_backend(io_backend);
+    web_socket_server.set_busy_poll(reactor_spin);
+    // state broadcasts are the only buffers shared between connections
+    const std::size_t zerocopy_threshold = std::stoul(config.get_config("zerocopy_threshold").value_or("32768"));
+    web_socket_server.set_zerocopy_threshold(zerocopy_threshold);
+    web_socket_server.set_limits(limits);
+    web_socket_server.set_listen_backlog(listen_backlog);
+    web_socket_server.set_socket_options(load_socket_options(config, "websocket"));
+    if (config.get_config("listeners.websocket.tls").value_or("false") == "true") web_socket_server.set_tls(tls);
+    // reconnecting clients all come back at once after a restart
+    const double handshake_rate = std::stod(config.get_config("handshake_rate").value_or("500"));
+    if (handshake_rate > 0) {
+        web_socket_server.set_admission(
+            handshake_rate,
+            std::stoul(config.get_config("handshake_burst").value_or("100")),
+            std::stoul(config.get_config("handshake_queue").value_or("2000")),
+            std::chrono::seconds(std::stoi(config.get_config("handshake_retry_jitter").value_or("10")))
+        );
+    }
+    web_socket_server.set_client_timeout(std::chrono::seconds(
+        std::stoi(config.get_config("websocket_timeout").value_or("120"))
+    ));
     web_socket_server.start(
         std::stoi(config.get_config("websocket_port").value_or("4040")), 
-        config.get_config("address").value_or("0.0.0.0")
+        load_listener_address(config, "websocket")
     );
     web_socket_server.run();
-    keep_alive();
 
+    if (inherited.has_value()) {
+        for (auto& connection : inherited->servers.at(1).connections) {
+            web_socket_server.adopt_connection(std::move(connection));
+        }
+        handoff.acknowledge();
+        Logger::instance().info("Took over from the previous process");
+    }
+
+    const int stats_interval = std::stoi(config.get_config("connection_stats_interval").value_or("60"));
+    if (stats_interval > 0) {
+        game_cron.add_job("connection_stats", [&]() {
+            log_connection_stats("HTTP", server);
+            log_connection_stats("WebSocket", web_socket_server);
+            log_limit_stats("HTTP", server);
+            log_limit_stats("WebSocket", web_socket_server);
+            log_admission_stats("WebSocket", web_socket_server);
+            log_overload_stats("HTTP", server);
+            log_lane_stats("HTTP", server);
+            log_compression_stats(server);
+            if (zerocopy_threshold > 0) log_zerocopy_stats("WebSocket", web_socket_server);
+            if (tls) log_tls_stats(*tls);
+        }, std::chrono::seconds(stats_interval));
+    }
+
+    std::atomic<bool> handed_off{false};
+    if (!handoff_path.empty()) {
+        handoff.serve(
+            [&]() {
+                return prepare_handoff(server, web_socket_server, tls);
+            },
+            [&](bool acknowledged, Handoff::Payload& payload) {
+                if (acknowledged) {
+                    handed_off = true;
+                    return;
+                }
+                resume_after_failed_handoff(server, web_socket_server, payload);
+            }
+        ).log_error("Binary upgrades are disabled");
+    }
+    keep_alive(handed_off);
+    game_cron.remove_job("connection_stats");
+
+    drain_http(server, std::chrono::seconds(
+        std::stoi(config.get_config("handoff_drain_timeout").value_or("10"))
+    ));
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "server/http/http_compression.h"
+
+#include <zlib.h>
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+
+// deflate output grows by this much at a time
+constexpr std::size_t OUTPUT_CHUNK = 16 * 1024;
+
+struct DeflateStream {
+    z_stream stream{};
+    // level the stream was set up with, -1 before
+    int level = -1;
+
+    ~DeflateStream() {
+        if (level >= 0) deflateEnd(&stream);
+    }
+};
+
+// one per coding, gzip first
+thread_local DeflateStream deflate_streams[2];
+
+bool equals_ignore_case(std::string_view left, std::string_view right) {
+    if (left.size() != right.size()) return false;
+    for (std::size_t i = 0; i < left.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(left[i])) != std::tolower(static_cast<unsigned char>(right[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view value) {
+    std::size_t start = value.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return std::string_view();
+    std::size_t end = value.find_last_not_of(" \t");
+    return value.substr(start, end - start + 1);
+}
+
+// q of one Accept-Encoding entry's parameters, 1 when it has none
+double quality(std::string_view parameters) {
+    while (!parameters.empty()) {
+        std::size_t semicolon = parameters.find(';');
+        std::string_view parameter = trim(parameters.substr(0, semicolon));
+        if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+            // short enough to stay in the string's inline buffer
+            return std::strtod(std::string(parameter.substr(2)).c_str(), nullptr);
+        }
+        if (semicolon == std::string_view::npos) break;
+        parameters = parameters.substr(semicolon + 1);
+    }
+    return 1;
+}
+
+}  // namespace
+
+ContentEncoding HttpCompression::negotiate(std::string_view accept_encoding) {
+    // -1 while the coding is not listed
+    double gzip = -1;
+    double deflate = -1;
+    double any = -1;
+    while (!accept_encoding.empty()) {
+        std::size_t comma = accept_encoding.find(',');
+        std::string_view entry = accept_encoding.substr(0, comma);
+        std::size_t semicolon = entry.find(';');
+        std::string_view coding = trim(entry.substr(0, semicolon));
+        double q = semicolon == std::string_view::npos ? 1 : quality(entry.substr(semicolon + 1));
+        if (equals_ignore_case(coding, "gzip") || equals_ignore_case(coding, "x-gzip")) {
+            gzip = q;
+        } else if (equals_ignore_case(coding, "deflate")) {
+            deflate = q;
+        } else if (coding == "*") {
+            any = q;
+        }
+        if (comma == std::string_view::npos) break;
+        accept_encoding = accept_encoding.substr(comma + 1);
+    }
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+    if (gzip > 0 && gzip >= deflate) return ContentEncoding::GZIP;
+    if (deflate > 0) return ContentEncoding::DEFLATE;
+    return ContentEncoding::IDENTITY;
+}
+
+std::string_view HttpCompression::name(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::GZIP: return "gzip";
+        case ContentEncoding::DEFLATE: return "deflate";
+        default: return "identity";
+    }
+}
+
+Result<std::string> HttpCompression::compress(std::string_view data, ContentEncoding encoding, int level) {
+    if (encoding == ContentEncoding::IDENTITY) return Result<std::string>(std::string(data));
+    if (data.size() > UINT_MAX) return Result<std::string>(Error("Body too large to compress"));
+
+    DeflateStream& deflater = deflate_streams[encoding == ContentEncoding::GZIP ? 0 : 1];
+    z_stream& stream = deflater.stream;
+    if (deflater.level != level) {
+        if (deflater.level >= 0) deflateEnd(&stream);
+        stream = z_stream{};
+        deflater.level = -1;
+        // 16 more window bits ask for the gzip wrapper instead of zlib's
+        int window_bits = encoding == ContentEncoding::GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+        if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return Result<std::string>(Error("Failed to set up zlib"));
+        }
+        deflater.level = level;
+    } else if (deflateReset(&stream) != Z_OK) {
+        return Result<std::string>(Error("Failed to reset zlib"));
+    }
+
+    std::string output;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        std::size_t written = output.size();
+        output.resize(written + OUTPUT_CHUNK);
+        stream.next_out = reinterpret_cast<Bytef*>(&output[written]);
+        stream.avail_out = OUTPUT_CHUNK;
+        status = deflate(&stream, Z_FINISH);
+        output.resize(written + OUTPUT_CHUNK - stream.avail_out);
+    }
+    if (status != Z_STREAM_END) {
+        return Result<std::string>(Error("zlib failed to compress: " + std::to_string(status)));
+    }
+    return Result<std::string>(std::move(output));
+}
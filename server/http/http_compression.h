@@ -0,0 +1,35 @@
+#pragma once
+
+#include "server/utils/result.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class ContentEncoding : std::uint8_t {
+    IDENTITY,
+    GZIP,
+    DEFLATE,
+};
+
+// Response body compression with zlib. Every thread keeps a deflate stream
+// per coding and resets it between bodies, so a response does not pay for
+// setting up zlib's few hundred KiB of state.
+class HttpCompression {
+  public:
+    struct Options {
+        // zlib level, 1 fastest to 9 smallest; 0 turns compression off
+        int level = 6;
+        // bodies shorter than this go out as they are
+        std::size_t min_size = 1024;
+    };
+
+    // The coding the client prefers out of Accept-Encoding, gzip on a tie;
+    // IDENTITY when it accepts neither.
+    static ContentEncoding negotiate(std::string_view accept_encoding);
+    // Content-Encoding value of encoding.
+    static std::string_view name(ContentEncoding encoding);
+    // data compressed as one gzip or zlib stream, written out in chunks.
+    static Result<std::string> compress(std::string_view data, ContentEncoding encoding, int level);
+};
@@ -1,6 +1,6 @@
 #include "server/http/http_enums.h"
 
-HttpMethod parse_method(const std::string& method_str) {
+HttpMethod parse_method(std::string_view method_str) {
     if (method_str == "GET") return HttpMethod::GET;
     if (method_str == "POST") return HttpMethod::POST;
     if (method_str == "PUT") return HttpMethod::PUT;
@@ -19,13 +19,19 @@ std::string get_status_message(HttpStatusCode status_code) {
         case HttpStatusCode::BAD_REQUEST: return "Bad Request";
         case HttpStatusCode::NOT_FOUND: return "Not Found";
         case HttpStatusCode::METHOD_NOT_ALLOWED: return "Method Not Allowed";
+        case HttpStatusCode::PAYLOAD_TOO_LARGE: return "Payload Too Large";
+        case HttpStatusCode::REQUEST_HEADER_FIELDS_TOO_LARGE: return "Request Header Fields Too Large";
         case HttpStatusCode::INTERNAL_SERVER_ERROR: return "Internal Server Error";
+        case HttpStatusCode::NOT_IMPLEMENTED: return "Not Implemented";
+        case HttpStatusCode::SERVICE_UNAVAILABLE: return "Service Unavailable";
         case HttpStatusCode::NO_CONTENT: return "No Content";
+        case HttpStatusCode::NOT_MODIFIED: return "Not Modified";
         case HttpStatusCode::FORBIDDEN: return "Forbidden";
         default: return "OK";
     }
 }
-HttpVersion parse_version(const std::string& version_str) {
+HttpVersion parse_version(std::string_view version_str) {
+    if (version_str == "HTTP/1.0") return HttpVersion::HTTP_1_0;
     if (version_str == "HTTP/1.1") return HttpVersion::HTTP_1_1;
     if (version_str == "HTTP/2.0") return HttpVersion::HTTP_2_0;
     if (version_str == "HTTP/3.0") return HttpVersion::HTTP_3_0;
@@ -34,6 +40,7 @@ HttpVersion parse_version(const std::string& version_str) {
 
 std::string http_version_to_string(HttpVersion http_version) {
     switch (http_version) {
+        case HttpVersion::HTTP_1_0: return "HTTP/1.0";
         case HttpVersion::HTTP_1_1: return "HTTP/1.1";
         case HttpVersion::HTTP_2_0: return "HTTP/2.0";
         case HttpVersion::HTTP_3_0: return "HTTP/3.0";
@@ -56,11 +63,16 @@ std::string method_to_string(HttpMethod method) {
 std::string status_code_to_string(HttpStatusCode status_code) {
     switch (status_code) {
         case HttpStatusCode::OK: return "200";
+        case HttpStatusCode::NOT_MODIFIED: return "304";
         case HttpStatusCode::SWITCHING_PROTOCOLS: return "101";
         case HttpStatusCode::BAD_REQUEST: return "400";
         case HttpStatusCode::NOT_FOUND: return "404";
         case HttpStatusCode::METHOD_NOT_ALLOWED: return "405";
+        case HttpStatusCode::PAYLOAD_TOO_LARGE: return "413";
+        case HttpStatusCode::REQUEST_HEADER_FIELDS_TOO_LARGE: return "431";
         case HttpStatusCode::INTERNAL_SERVER_ERROR: return "500";
+        case HttpStatusCode::NOT_IMPLEMENTED: return "501";
+        case HttpStatusCode::SERVICE_UNAVAILABLE: return "503";
         case HttpStatusCode::NO_CONTENT: return "204";
         case HttpStatusCode::FORBIDDEN: return "403";
         default: return "200";
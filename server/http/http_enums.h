@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 enum class HttpMethod{
   GET,
@@ -18,14 +19,20 @@ enum class HttpStatusCode{
   SWITCHING_PROTOCOLS = 101,
   OK = 200, 
   NO_CONTENT = 204,
+  NOT_MODIFIED = 304,
   BAD_REQUEST = 400,
   NOT_FOUND = 404,
   METHOD_NOT_ALLOWED = 405,
+  PAYLOAD_TOO_LARGE = 413,
+  REQUEST_HEADER_FIELDS_TOO_LARGE = 431,
   INTERNAL_SERVER_ERROR = 500,
+  NOT_IMPLEMENTED = 501,
+  SERVICE_UNAVAILABLE = 503,
   FORBIDDEN = 403,
 };
 
 enum class HttpVersion{
+  HTTP_1_0,
   HTTP_1_1,
   HTTP_2_0,
   HTTP_3_0,
@@ -35,7 +42,7 @@ enum class HttpVersion{
 std::string http_version_to_string(HttpVersion http_version);
 
 // Parse HTTP method from string
-HttpMethod parse_method(const std::string& method_str);
+HttpMethod parse_method(std::string_view method_str);
 
 std::string get_status_message(HttpStatusCode status_code);
 
@@ -43,4 +50,4 @@ std::string status_code_to_string(HttpStatusCode status_code);
 
 std::string method_to_string(HttpMethod method);
 
-HttpVersion parse_version(const std::string& version_str);
\ No newline at end of file
+HttpVersion parse_version(std::string_view version_str);
\ No newline at end of file
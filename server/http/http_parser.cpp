@@ -0,0 +1,175 @@
+#include "server/http/http_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+namespace {
+
+bool equals_ignore_case(std::string_view left, std::string_view right) {
+    return left.size() == right.size() && std::equal(left.begin(), left.end(), right.begin(),
+        [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        });
+}
+
+std::string_view trim(std::string_view value) {
+    std::size_t start = value.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return std::string_view();
+    std::size_t end = value.find_last_not_of(" \t");
+    return value.substr(start, end - start + 1);
+}
+
+// Header lines between the request line and the blank line starting at
+// header_end, each with its CRLF.
+std::string_view header_block(std::string_view data, std::size_t header_end) {
+    std::size_t line_end = data.find("\r\n");
+    return data.substr(line_end + 2, header_end - line_end);
+}
+
+}  // namespace
+
+std::optional<std::size_t> HttpParser::frame(std::string_view data, FramingState& state) {
+    if (state.length == 0) {
+        // the blank line may have begun in what the last call saw
+        std::size_t from = state.scanned > 3 ? state.scanned - 3 : 0;
+        std::size_t header_end = data.find("\r\n\r\n", from);
+        if (header_end == std::string_view::npos) {
+            state.scanned = static_cast<std::uint32_t>(std::min<std::size_t>(data.size(), UINT32_MAX));
+            return std::nullopt;
+        }
+        // a body that cannot be framed is left out, check_limits rejects
+        // the request and nothing after it is read
+        std::size_t body = content_length(header_block(data, header_end)).value_or(0);
+        // a body this large is over any limit and never completes
+        state.length = body > UINT32_MAX - header_end - 4
+            ? UINT32_MAX
+            : static_cast<std::uint32_t>(header_end + 4 + body);
+    }
+    if (data.size() < state.length) return std::nullopt;
+    return state.length;
+}
+
+std::optional<HttpParser::Request> HttpParser::parse(std::string_view message) {
+    std::size_t line_end = message.find("\r\n");
+    if (line_end == std::string_view::npos) return std::nullopt;
+
+    // method SP target SP version, nothing else
+    std::string_view line = message.substr(0, line_end);
+    std::size_t first = line.find(' ');
+    if (first == 0 || first == std::string_view::npos) return std::nullopt;
+    std::size_t second = line.find(' ', first + 1);
+    if (second == std::string_view::npos || second == first + 1) return std::nullopt;
+    if (line.find(' ', second + 1) != std::string_view::npos) return std::nullopt;
+
+    Request request;
+    request.method = line.substr(0, first);
+    request.target = line.substr(first + 1, second - first - 1);
+    request.version = line.substr(second + 1);
+    if (request.version.substr(0, 5) != "HTTP/") return std::nullopt;
+
+    std::size_t header_end = message.find("\r\n\r\n", line_end);
+    if (header_end == std::string_view::npos) return std::nullopt;
+    request.headers = header_block(message, header_end);
+    request.body = message.substr(header_end + 4);
+
+    for (std::string_view rest = request.headers; !rest.empty();) {
+        std::size_t end = rest.find("\r\n");
+        std::string_view header = rest.substr(0, end);
+        rest = rest.substr(end + 2);
+        std::size_t colon = header.find(':');
+        // no whitespace between a field name and its colon
+        if (colon == 0 || colon == std::string_view::npos ||
+            header.substr(0, colon).find_first_of(" \t") != std::string_view::npos) {
+            return std::nullopt;
+        }
+    }
+    return request;
+}
+
+std::optional<std::string_view> HttpParser::find_header(std::string_view headers, std::string_view name) {
+    while (!headers.empty()) {
+        std::size_t end = headers.find("\r\n");
+        std::string_view header = headers.substr(0, end);
+        headers = end == std::string_view::npos ? std::string_view() : headers.substr(end + 2);
+        std::size_t colon = header.find(':');
+        if (colon == std::string_view::npos || !equals_ignore_case(header.substr(0, colon), name)) continue;
+        return trim(header.substr(colon + 1));
+    }
+    return std::nullopt;
+}
+
+bool HttpParser::has_token(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        std::size_t comma = value.find(',');
+        if (equals_ignore_case(trim(value.substr(0, comma)), token)) return true;
+        if (comma == std::string_view::npos) break;
+        value = value.substr(comma + 1);
+    }
+    return false;
+}
+
+bool HttpParser::matches_etag(std::string_view value, std::string_view etag) {
+    if (trim(value) == "*") return true;
+    while (!value.empty()) {
+        std::size_t comma = value.find(',');
+        std::string_view tag = trim(value.substr(0, comma));
+        if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+        if (tag == etag) return true;
+        if (comma == std::string_view::npos) break;
+        value = value.substr(comma + 1);
+    }
+    return false;
+}
+
+std::optional<std::size_t> HttpParser::content_length(std::string_view headers) {
+    auto value = find_header(headers, "Content-Length");
+    if (!value.has_value()) return 0;
+    if (value->empty()) return std::nullopt;
+    // a second one, even with the same value, may be the one a proxy in
+    // front of the server framed the request by
+    std::size_t end = headers.find("\r\n", static_cast<std::size_t>(value->data() - headers.data()));
+    if (end != std::string_view::npos && find_header(headers.substr(end + 2), "Content-Length").has_value()) {
+        return std::nullopt;
+    }
+    std::size_t length = 0;
+    for (char digit : *value) {
+        if (digit < '0' || digit > '9') return std::nullopt;
+        std::size_t next = length * 10 + static_cast<std::size_t>(digit - '0');
+        // saturates, which any body limit rejects
+        if (next / 10 != length) return SIZE_MAX;
+        length = next;
+    }
+    return length;
+}
+
+std::optional<HttpStatusCode> HttpParser::check_framing(std::string_view headers) {
+    if (find_header(headers, "Transfer-Encoding").has_value()) return HttpStatusCode::NOT_IMPLEMENTED;
+    if (!content_length(headers).has_value()) return HttpStatusCode::BAD_REQUEST;
+    return std::nullopt;
+}
+
+std::string_view HttpParser::peek_path(std::string_view data) {
+    std::string_view line = data.substr(0, data.find("\r\n"));
+    std::size_t start = line.find(' ');
+    if (start == std::string_view::npos) return std::string_view();
+    std::size_t end = line.find(' ', start + 1);
+    return line.substr(start + 1, end == std::string_view::npos ? std::string_view::npos : end - start - 1);
+}
+
+std::string_view HttpParser::peek_method(std::string_view data) {
+    std::string_view line = data.substr(0, data.find("\r\n"));
+    return line.substr(0, line.find(' '));
+}
+
+std::optional<HttpStatusCode> HttpParser::check_limits(std::string_view data, std::size_t max_header_bytes, std::size_t max_body_bytes) {
+    std::size_t header_end = data.find("\r\n\r\n");
+    std::size_t header_bytes = header_end == std::string_view::npos ? data.size() : header_end + 4;
+    if (header_bytes > max_header_bytes) return HttpStatusCode::REQUEST_HEADER_FIELDS_TOO_LARGE;
+    if (header_end == std::string_view::npos) return std::nullopt;
+    std::string_view headers = header_block(data, header_end);
+    auto framing = check_framing(headers);
+    if (framing.has_value()) return framing;
+    if (*content_length(headers) > max_body_bytes) return HttpStatusCode::PAYLOAD_TOO_LARGE;
+    return std::nullopt;
+}
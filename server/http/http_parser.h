@@ -0,0 +1,64 @@
+#pragma once
+
+#include "server/http/http_enums.h"
+#include "server/server/tcp_socket.h"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// HTTP/1.1 request parsing over raw input, without copies or allocations:
+// every part of a request comes back as a view into the bytes it was given.
+//
+// frame() runs on the loop thread each time more input arrives for an
+// incomplete request. The FramingState it keeps in the socket records how
+// far the header was searched, and the request's length once the header is
+// complete, so a request that trickles in is scanned once rather than from
+// the start on every read.
+class HttpParser {
+  public:
+    // The parts of one complete request.
+    struct Request {
+        std::string_view method;
+        std::string_view target;
+        std::string_view version;
+        // header lines, each ending in CRLF, without the blank line
+        std::string_view headers;
+        std::string_view body;
+    };
+
+    // Length of the request at the start of data once its header and
+    // Content-Length bytes of body have arrived. data is the unread input,
+    // which only grows between calls on the same request.
+    static std::optional<std::size_t> frame(std::string_view data, FramingState& state);
+    // Splits a complete request as framed by frame(); nullopt if it is
+    // malformed.
+    static std::optional<Request> parse(std::string_view message);
+    // Value of the first header called name, compared case-insensitively,
+    // with surrounding whitespace trimmed.
+    static std::optional<std::string_view> find_header(std::string_view headers, std::string_view name);
+    // Whether the comma separated header value lists token, case-insensitively,
+    // as in Connection: keep-alive, Upgrade.
+    static bool has_token(std::string_view value, std::string_view token);
+    // Whether an If-None-Match value lists etag, or is *. Weak tags compare
+    // equal to the strong tag of the same value.
+    static bool matches_etag(std::string_view value, std::string_view etag);
+    // Content-Length of a header block, 0 if there is none; nullopt if it is
+    // not a plain number or the header appears more than once.
+    static std::optional<std::size_t> content_length(std::string_view headers);
+    // Status to reject a complete header block with when its body cannot be
+    // framed the way frame() does: 400 for a bad Content-Length, 501 for any
+    // Transfer-Encoding. Accepting either would let the next pipelined
+    // request start somewhere the client did not mean it to.
+    static std::optional<HttpStatusCode> check_framing(std::string_view headers);
+
+    // For input that may be incomplete or not framed yet.
+    //
+    // Path and method of the request line.
+    static std::string_view peek_path(std::string_view data);
+    static std::string_view peek_method(std::string_view data);
+    // Status to reject the request with if its header, complete or not, or
+    // its announced body is over the limit, or its complete header fails
+    // check_framing.
+    static std::optional<HttpStatusCode> check_limits(std::string_view data, std::size_t max_header_bytes, std::size_t max_body_bytes);
+};
@@ -1,26 +1,31 @@
 #pragma once
 
 #include "server/http/http_enums.h"
-#include "server/http/http_header.h"
+#include "server/http/http_parser.h"
+#include <optional>
 #include <string>
-#include <vector>
-#include <unordered_map>
+#include <string_view>
 
+// A request parsed in place: the path, headers and body are views into the
+// message it was made from, which has to outlive it.
 class HttpRequest{
   private:
-    HttpMethod method;
-    std::string path;
-    std::vector<HttpHeader> headers;
-    std::string body;
-    HttpVersion version;
+    bool valid = false;
+    HttpMethod method = HttpMethod::GET;
+    HttpVersion version = HttpVersion::HTTP_1_1;
+    HttpParser::Request parts;
 
   public:
-    HttpRequest(std::string raw_request);
+    explicit HttpRequest(std::string_view message);
 
+    // False if the message was not a well-formed request; nothing else is
+    // meaningful then.
+    bool is_valid() const;
     HttpMethod get_method() const;
-    std::string get_path() const;
-    std::unordered_map<std::string, std::string> get_headers() const;
-    std::string get_body() const;
+    HttpVersion get_version() const;
+    std::string_view get_path() const;
+    // Value of the header called name, compared case-insensitively.
+    std::optional<std::string_view> get_header(std::string_view name) const;
+    std::string_view get_body() const;
     std::string to_string() const;
 };
-
@@ -1,91 +1,166 @@
 #include "server/http/http_response.h"
 #include "server/http/http_enums.h"
 #include "server/utils/config.h"
-#include <sstream>
+#include <charconv>
+#include <unordered_map>
+
+// Status lines of every code the server answers with.
+static const std::string* cached_status_line(HttpVersion http_version, HttpStatusCode status_code) {
+    static const std::unordered_map<int, std::string> lines = [] {
+        std::unordered_map<int, std::string> lines;
+        for (HttpStatusCode code : {
+                 HttpStatusCode::SWITCHING_PROTOCOLS, HttpStatusCode::OK, HttpStatusCode::NO_CONTENT,
+                 HttpStatusCode::NOT_MODIFIED,
+                 HttpStatusCode::BAD_REQUEST, HttpStatusCode::FORBIDDEN, HttpStatusCode::NOT_FOUND,
+                 HttpStatusCode::METHOD_NOT_ALLOWED, HttpStatusCode::PAYLOAD_TOO_LARGE,
+                 HttpStatusCode::REQUEST_HEADER_FIELDS_TOO_LARGE, HttpStatusCode::INTERNAL_SERVER_ERROR,
+                 HttpStatusCode::NOT_IMPLEMENTED, HttpStatusCode::SERVICE_UNAVAILABLE}) {
+            lines.emplace(static_cast<int>(code), http_version_to_string(HttpVersion::HTTP_1_1) + " " +
+                                                      status_code_to_string(code) + " " +
+                                                      get_status_message(code) + "\r\n");
+        }
+        return lines;
+    }();
+    if (http_version != HttpVersion::HTTP_1_1) return nullptr;
+    auto line = lines.find(static_cast<int>(status_code));
+    return line == lines.end() ? nullptr : &line->second;
+}
+
+static const std::string& cors_block() {
+    static const std::string block = [] {
+        std::string allowed_origin = Config::instance().get_allowed_origin();
+        return
+            "Access-Control-Allow-Origin: " + allowed_origin + "\r\n"
+            "Access-Control-Allow-Headers: Content-Type\r\n"
+            "Access-Control-Allow-Credentials: true\r\n"
+            "Access-Control-Max-Age: 86400\r\n"
+            "Access-Control-Expose-Headers: Content-Type, ETag\r\n"
+            "Access-Control-Allow-Methods: GET, POST, OPTIONS, PUT, DELETE, PATCH\r\n";
+    }();
+    return block;
+}
 
 HttpResponse::HttpResponse(std::optional<std::string> body, HttpVersion http_version, HttpStatusCode status_code)
     : body(std::move(body)), http_version(http_version), status_code(status_code) {
-        status_message = get_status_message(status_code);
-        
-    
 }
 
 HttpResponse HttpResponse::from_json(const Result<nlohmann::json> & json) {
     if (json.is_err()) {
         Error error = json.unwrap_err(false);
-        auto status = error.get_http_status_code();
-        std::string error_message = nlohmann::json({{"message", error.get_message(false)}}).dump();
-
-        return HttpResponse(
-            error_message,
+        HttpResponse response(
+            nlohmann::json({{"message", error.get_message(false)}}).dump(),
             HttpVersion::HTTP_1_1,
-            status
-        )
-        .add_header(HttpHeader::content_type("application/json"))
-        .add_header(HttpHeader::content_length(error_message))
-        .add_cors_headers();
+            error.get_http_status_code()
+        );
+        response.add_header(HttpHeader::content_type("application/json")).add_cors_headers();
+        return response;
     }
-    
-    std::string response_body = json.unwrap().dump();
-    return HttpResponse(
-        response_body,
+
+    HttpResponse response(
+        json.unwrap().dump(),
         HttpVersion::HTTP_1_1,
         HttpStatusCode::OK
-    )
-    .add_header(HttpHeader::content_type("application/json"))
-    .add_header(HttpHeader::content_length(response_body))
-    .add_cors_headers();
+    );
+    response.add_header(HttpHeader::content_type("application/json")).add_cors_headers();
+    return response;
 }
 
-HttpResponse HttpResponse::add_header(const HttpHeader& header) {
-    headers.push_back(header);
+HttpResponse& HttpResponse::add_header(const HttpHeader& header) {
+    headers.append(header.get_name()).append(": ").append(header.get_value()).append("\r\n");
     return *this;
 }
 
 std::string HttpResponse::to_string() const {
-    std::stringstream response_stream;
-    response_stream 
-    << http_version_to_string(http_version) 
-    << " " << status_code_to_string(status_code) 
-    << " " << get_status_message(status_code) << "\r\n";
-    
-    for (const auto& header : headers) {
-        response_stream << header.get_name() << ": " << header.get_value() << "\r\n";
-    }
-    response_stream << "\r\n" << body.value_or("");
-    return response_stream.str();
+    std::string response;
+    append_to(response);
+    return response;
 }
 
-HttpResponse HttpResponse::add_cors_headers() {
-    
-    Config& config = Config::instance();
-    std::string allowed_origin = config.get_allowed_origin();
+void HttpResponse::append_to(std::string& output) const {
+    const std::string* status_line = cached_status_line(http_version, status_code);
+    std::string built_line;
+    if (status_line == nullptr) {
+        built_line = http_version_to_string(http_version) + " " + status_code_to_string(status_code) + " " +
+                     get_status_message(status_code) + "\r\n";
+        status_line = &built_line;
+    }
+    static constexpr std::string_view connection_name = "Connection: ";
+    static constexpr std::string_view etag_name = "ETag: ";
+    static constexpr std::string_view length_name = "Content-Length: ";
+    char length[24];
+    std::size_t length_size = 0;
+    if (body.has_value()) {
+        length_size = std::to_chars(length, length + sizeof(length), body->size()).ptr - length;
+    }
+
+    output.reserve(output.size() + status_line->size() + headers.size() +
+                   (cors ? cors_block().size() : 0) +
+                   (connection.empty() ? 0 : connection_name.size() + connection.size() + 2) +
+                   (etag.empty() ? 0 : etag_name.size() + 2 + etag.size() + 2) +
+                   (body.has_value() ? length_name.size() + length_size + 2 + body->size() : 0) + 2);
+    output.append(*status_line).append(headers);
+    if (!etag.empty()) output.append(etag_name).append(weak_etag ? "W/" : "").append(etag).append("\r\n");
+    if (cors) output.append(cors_block());
+    if (!connection.empty()) output.append(connection_name).append(connection).append("\r\n");
+    if (body.has_value()) output.append(length_name).append(length, length_size).append("\r\n");
+    output.append("\r\n");
+    if (body.has_value()) output.append(*body);
+}
 
-    add_header(HttpHeader("Access-Control-Allow-Origin", allowed_origin));
-    add_header(HttpHeader("Access-Control-Allow-Headers", "Content-Type"));
-    add_header(HttpHeader("Access-Control-Allow-Credentials", "true"));
-    add_header(HttpHeader("Access-Control-Max-Age", "86400"));
-    add_header(HttpHeader("Access-Control-Expose-Headers", "Content-Type"));
-    add_header(HttpHeader("Connection", "keep-alive"));
-    add_header(HttpHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS, PUT, DELETE, PATCH"));
+HttpResponse& HttpResponse::add_cors_headers() {
+    cors = true;
+    connection = "keep-alive";
+    return *this;
+}
 
+HttpResponse& HttpResponse::close_connection() {
+    connection = "close";
     return *this;
 }
 
-HttpResponse HttpResponse::option_response(std::vector<HttpMethod> allowed_methods) {
+HttpResponse HttpResponse::option_response(const std::vector<HttpMethod>& allowed_methods) {
     std::string allowed_methods_string = "";
     for (const auto& method : allowed_methods) {
         allowed_methods_string += method_to_string(method) + ", ";
     }
     allowed_methods_string = allowed_methods_string.substr(0, allowed_methods_string.size() - 2);
 
-    return HttpResponse(
+    HttpResponse response(
         std::nullopt,
         HttpVersion::HTTP_1_1,
         HttpStatusCode::NO_CONTENT
-    )
-    .add_cors_headers()
-    .add_header(HttpHeader("Allow", allowed_methods_string));
+    );
+    response.add_cors_headers().add_header(HttpHeader("Allow", allowed_methods_string));
+    return response;
+}
+
+HttpResponse HttpResponse::not_modified(const std::string& etag) {
+    HttpResponse response(
+        std::nullopt,
+        HttpVersion::HTTP_1_1,
+        HttpStatusCode::NOT_MODIFIED
+    );
+    response.add_etag(etag).add_cors_headers();
+    return response;
+}
+
+HttpResponse& HttpResponse::add_etag(const std::string& etag) {
+    this->etag = etag;
+    return add_header(HttpHeader("Cache-Control", "no-cache"));
+}
+
+const std::optional<std::string>& HttpResponse::get_body() const {
+    return body;
+}
+
+const std::string& HttpResponse::get_etag() const {
+    return etag;
+}
+
+HttpResponse& HttpResponse::set_encoded_body(ContentEncoding encoding, std::string body) {
+    this->body = std::move(body);
+    weak_etag = true;
+    return add_header(HttpHeader("Content-Encoding", std::string(HttpCompression::name(encoding))));
 }
 
 HttpStatusCode HttpResponse::get_status_code() const {
@@ -93,5 +168,6 @@ HttpStatusCode HttpResponse::get_status_code() const {
 }
 
 bool HttpResponse::is_success() const {
-    return status_code == HttpStatusCode::OK || status_code == HttpStatusCode::NO_CONTENT;
+    return status_code == HttpStatusCode::OK || status_code == HttpStatusCode::NO_CONTENT ||
+           status_code == HttpStatusCode::NOT_MODIFIED;
 }
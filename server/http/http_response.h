@@ -1,30 +1,57 @@
 #pragma once
 
+#include "server/http/http_compression.h"
 #include "server/http/http_enums.h"
 #include "server/http/http_header.h"
 #include "server/utils/result.h"
 #include "nlohmann/json.hpp"
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Built by chaining on one object and serialised in a single pass. The
+// status lines and the CORS block are formatted once per process, from the
+// config loaded at startup; a response only formats its own headers and
+// its Content-Length.
 class HttpResponse{
   private:
     HttpVersion http_version;
     HttpStatusCode status_code;
-    std::string status_message;
-    std::vector<HttpHeader> headers;
+    // lines added by add_header, each ending in CRLF
+    std::string headers;
     std::optional<std::string> body;
+    bool cors = false;
+    // value of the Connection header, none while empty
+    std::string_view connection;
+    // none while empty
+    std::string etag;
+    // a compressed body is only equivalent to the one the tag names
+    bool weak_etag = false;
 
   public:
     HttpResponse(std::optional<std::string> body, HttpVersion http_version, HttpStatusCode status_code);
     static HttpResponse from_json(const Result<nlohmann::json> & json);
-    HttpResponse add_header(const HttpHeader& header);
-    HttpResponse add_cors_headers();
+    HttpResponse& add_header(const HttpHeader& header);
+    // The cached CORS block, and Connection: keep-alive.
+    HttpResponse& add_cors_headers();
+    // Connection: close instead of keep-alive.
+    HttpResponse& close_connection();
     HttpStatusCode get_status_code() const;
+    const std::optional<std::string>& get_body() const;
+    const std::string& get_etag() const;
+    // Puts body, which is the current body compressed with encoding, in its
+    // place. The ETag becomes weak.
+    HttpResponse& set_encoded_body(ContentEncoding encoding, std::string body);
     std::string to_string() const;
-    static HttpResponse option_response(std::vector<HttpMethod> allowed_methods);
+    // Appends the response to output; to_string() is this on an empty one.
+    void append_to(std::string& output) const;
+    static HttpResponse option_response(const std::vector<HttpMethod>& allowed_methods);
+    // 304 for a client whose copy is still etag.
+    static HttpResponse not_modified(const std::string& etag);
+    // ETag, and Cache-Control: no-cache so browsers revalidate every time.
+    HttpResponse& add_etag(const std::string& etag);
     bool is_success() const;
 
 
 };
-
@@ -20,8 +20,9 @@ HttpServer::~HttpServer() {}
 
 void HttpServer::start(int port, std::string address) {
     Logger& logger = Logger::instance();
-    logger.info("Starting HTTP server on " + address + ":" + std::to_string(port));
+    logger.info("Starting HTTP server on " + describe_address(port, address));
     router.log_methods();
+    router.cache_preflights();
     TcpServer::start(port, address);
 }
 
@@ -30,7 +31,7 @@ void HttpServer::start(int port, std::string address) {
 std::string HttpServer::get_response_info(const HttpRequest& http_request,const HttpResponse& response, const TcpSocket& socket) const {
     return 
     method_to_string(http_request.get_method()) + 
-    " " + http_request.get_path() + 
+    " " + std::string(http_request.get_path()) + 
     " " + method_to_string(http_request.get_method()) + 
     " " + status_code_to_string(response.get_status_code()) + 
     " " + get_status_message(response.get_status_code()) + " " + socket.socket_info();
@@ -38,14 +39,145 @@ std::string HttpServer::get_response_info(const HttpRequest& http_request,const
 
 
 void HttpServer::on_client_connected(TcpSocket& client_socket) {
-    client_socket.set_protocol_callback([&](std::string data) {
-        if(data.empty()) return std::optional<std::string>();
-        return std::optional<std::string>(data);
+    client_socket.set_protocol_callback([](std::string_view data, FramingState& state) {
+        return HttpParser::frame(data, state);
     });
 }
+
+std::optional<std::string> HttpServer::check_limits(TcpSocket& client_socket, std::string_view input) {
+    const Limits& limits = get_limits();
+    auto status = HttpParser::check_limits(input, limits.max_header_bytes, limits.max_body_bytes);
+    if(!status.has_value()) return std::nullopt;
+    if(*status == HttpStatusCode::PAYLOAD_TOO_LARGE) count_limit(Limit::BODY);
+    if(*status == HttpStatusCode::REQUEST_HEADER_FIELDS_TOO_LARGE) count_limit(Limit::HEADER);
+    Logger::instance().warn("Rejecting request from " + client_socket.socket_info() + ": " + get_status_message(*status));
+    return HttpResponse::from_json(Result<nlohmann::json>(Error(get_status_message(*status), *status)))
+        .close_connection()
+        .to_string();
+}
+std::optional<std::string> HttpServer::shed_message(TcpSocket& client_socket, std::string_view message) {
+    if(critical_paths.count(std::string(HttpParser::peek_path(message)))) return std::nullopt;
+    HttpStatusCode status = HttpStatusCode::SERVICE_UNAVAILABLE;
+    HttpResponse response = HttpResponse::from_json(Result<nlohmann::json>(Error(get_status_message(status), status)));
+    response.add_header(HttpHeader("Retry-After", std::to_string(get_overload_policy().retry_after.count())));
+    // counts against max_requests like a handled request, so a client that
+    // is shed cannot keep one connection forever
+    HttpRequest request(message);
+    if(!request.is_valid() || !keeps_alive(client_socket, request)) {
+        client_socket.set_flag(TcpSocket::CLOSE_AFTER_RESPONSE);
+        response.close_connection();
+    }
+    return response.to_string();
+}
+
+Priority HttpServer::message_priority(TcpSocket&, std::string_view message) {
+    return router.get_priority(message);
+}
+
+void HttpServer::set_critical_paths(std::unordered_set<std::string> paths) {
+    critical_paths = std::move(paths);
+}
+
+void HttpServer::set_max_requests(std::uint32_t requests) {
+    max_requests = requests;
+}
+
+void HttpServer::set_handing_off(bool handing_off) {
+    this->handing_off = handing_off;
+}
+
+void HttpServer::set_compression(HttpCompression::Options options) {
+    compression = options;
+}
+
+HttpServer::CompressionStats HttpServer::get_compression_stats() const {
+    CompressionStats stats;
+    stats.compressed = compressed.load(std::memory_order_relaxed);
+    stats.cached = compressed_cached.load(std::memory_order_relaxed);
+    stats.bytes_in = compressed_bytes_in.load(std::memory_order_relaxed);
+    stats.bytes_out = compressed_bytes_out.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void HttpServer::compress_response(const HttpRequest& request, HttpResponse& response) {
+    const auto& body = response.get_body();
+    if(compression.level == 0 || !body.has_value() || body->size() < compression.min_size) return;
+    response.add_header(HttpHeader("Vary", "Accept-Encoding"));
+    auto accept_encoding = request.get_header("Accept-Encoding");
+    if(!accept_encoding.has_value()) return;
+    ContentEncoding encoding = HttpCompression::negotiate(*accept_encoding);
+    if(encoding == ContentEncoding::IDENTITY) return;
+
+    // a tagged body is the same for every request of its version
+    const std::string& etag = response.get_etag();
+    std::size_t slot = encoding == ContentEncoding::GZIP ? 0 : 1;
+    if(!etag.empty()) {
+        std::lock_guard<std::mutex> lock(cached_bodies_mutex);
+        auto cached = cached_bodies.find(request.get_path());
+        if(cached != cached_bodies.end() && cached->second[slot].etag == etag) {
+            const std::string& encoded = cached->second[slot].body;
+            compressed.fetch_add(1, std::memory_order_relaxed);
+            compressed_cached.fetch_add(1, std::memory_order_relaxed);
+            compressed_bytes_in.fetch_add(body->size(), std::memory_order_relaxed);
+            compressed_bytes_out.fetch_add(encoded.size(), std::memory_order_relaxed);
+            response.set_encoded_body(encoding, encoded);
+            return;
+        }
+    }
+
+    auto result = HttpCompression::compress(*body, encoding, compression.level);
+    if(result.log_error("Failed to compress response").is_err()) return;
+    std::string encoded = result.unwrap();
+    compressed.fetch_add(1, std::memory_order_relaxed);
+    compressed_bytes_in.fetch_add(body->size(), std::memory_order_relaxed);
+    compressed_bytes_out.fetch_add(encoded.size(), std::memory_order_relaxed);
+    if(!etag.empty()) {
+        std::lock_guard<std::mutex> lock(cached_bodies_mutex);
+        auto cached = cached_bodies.find(request.get_path());
+        if(cached == cached_bodies.end()) {
+            cached = cached_bodies.emplace(std::string(request.get_path()), std::array<CachedBody, 2>()).first;
+        }
+        cached->second[slot] = CachedBody{etag, encoded};
+    }
+    response.set_encoded_body(encoding, std::move(encoded));
+}
+
+bool HttpServer::keeps_alive(TcpSocket& socket, const HttpRequest& request) const {
+    std::uint32_t handled = socket.count_handled();
+    if(max_requests != 0 && handled >= max_requests) return false;
+    if(handing_off) return false;
+    auto connection = request.get_header("Connection");
+    if(request.get_version() == HttpVersion::HTTP_1_0) {
+        return connection.has_value() && HttpParser::has_token(*connection, "keep-alive");
+    }
+    return !connection.has_value() || !HttpParser::has_token(*connection, "close");
+}
+
 Result<std::string> HttpServer::handle_message(TcpSocket& socket, std::string message) {
+    // the request is views into message
     HttpRequest request(message);
+    if(!request.is_valid()) {
+        Logger::instance().error("Malformed request from " + socket.socket_info());
+        // what follows it cannot be framed reliably
+        socket.set_flag(TcpSocket::CLOSE_AFTER_RESPONSE);
+        return Result<std::string>(HttpResponse::from_json(
+            Result<nlohmann::json>(Error("Malformed request", HttpStatusCode::BAD_REQUEST)))
+            .close_connection()
+            .to_string());
+    }
+    bool keep_alive = keeps_alive(socket, request);
+    if(!keep_alive) socket.set_flag(TcpSocket::CLOSE_AFTER_RESPONSE);
+    if(request.get_method() == HttpMethod::OPTIONS) {
+        Logger::instance().info("OPTIONS " + std::string(request.get_path()) + " " +
+                                status_code_to_string(HttpStatusCode::NO_CONTENT) + " " + socket.socket_info());
+        return Result<std::string>(router.preflight(request.get_path(), keep_alive));
+    }
     HttpResponse response = router.handle_request(request);
+    if(!keep_alive) response.close_connection();
+    if(response.get_status_code() == HttpStatusCode::SERVICE_UNAVAILABLE) {
+        response.add_header(HttpHeader("Retry-After", std::to_string(get_overload_policy().retry_after.count())));
+    }
+    compress_response(request, response);
     auto response_info = get_response_info(request, response, socket);
     if(!response.is_success()) {
         Logger::instance().error(response_info);
@@ -5,21 +5,81 @@
 #include "server/http/server_method.h"
 #include "server/http/http_request.h"
 #include "server/http/http_response.h"
+#include "server/http/http_compression.h"
 #include "server/utils/result.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 
 class HttpServer : public TcpServer {
+  public:
+    struct CompressionStats {
+        // bodies sent compressed
+        std::uint64_t compressed = 0;
+        // of those, the ones taken from the cache
+        std::uint64_t cached = 0;
+        std::uint64_t bytes_in = 0;
+        std::uint64_t bytes_out = 0;
+    };
+
   protected:
+    // A compressed body of a route with an ETag, for the version it names.
+    struct CachedBody {
+        std::string etag;
+        std::string body;
+    };
     Router router;
+    // served even while overloaded
+    std::unordered_set<std::string> critical_paths{"/guess", "/ready"};
+    // requests answered on one connection before it is closed, 0 for no cap
+    std::uint32_t max_requests = 0;
+    // see set_handing_off
+    std::atomic<bool> handing_off{false};
+    HttpCompression::Options compression;
+    // latest compressed body per path, gzip then deflate, so every poller
+    // of one state version shares a single compression
+    std::mutex cached_bodies_mutex;
+    std::map<std::string, std::array<CachedBody, 2>, std::less<>> cached_bodies;
+    std::atomic<std::uint64_t> compressed{0};
+    std::atomic<std::uint64_t> compressed_cached{0};
+    std::atomic<std::uint64_t> compressed_bytes_in{0};
+    std::atomic<std::uint64_t> compressed_bytes_out{0};
 
     std::string get_response_info(const HttpRequest& http_request,const HttpResponse& response, const TcpSocket& socket) const;
+    // Whether the connection stays open after answering request: HTTP/1.1
+    // unless it asks for close, HTTP/1.0 only if it asks for keep-alive,
+    // and neither past max_requests nor while handing off.
+    bool keeps_alive(TcpSocket& socket, const HttpRequest& request) const;
+    // Compresses the body with the coding the request prefers, when it is
+    // long enough.
+    void compress_response(const HttpRequest& request, HttpResponse& response);
     Result<std::string> handle_message(TcpSocket& socket, std::string message) override;
     void on_client_connected(TcpSocket& client_socket) override;
+    std::optional<std::string> check_limits(TcpSocket& client_socket, std::string_view input) override;
+    // 503 with Retry-After for everything but the critical paths.
+    std::optional<std::string> shed_message(TcpSocket& client_socket, std::string_view message) override;
+    // The priority its route was declared with.
+    Priority message_priority(TcpSocket& client_socket, std::string_view message) override;
 
   public:
     HttpServer();
     virtual ~HttpServer();
 
     void start(int port, std::string address);
+    // Must be called before run().
+    void set_critical_paths(std::unordered_set<std::string> paths);
+    // Must be called before run().
+    void set_max_requests(std::uint32_t requests);
+    // Must be called before run().
+    void set_compression(HttpCompression::Options options);
+    CompressionStats get_compression_stats() const;
+    // While another process takes over, every response closes its
+    // connection, so clients reconnect to the new one.
+    void set_handing_off(bool handing_off);
 
     template <typename Body>
     void add_method(const ServerMethod<Body>& method) {
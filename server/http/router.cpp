@@ -33,24 +33,37 @@ std::vector<HttpMethod> Router::get_allowed_methods(const std::string& path) con
     return allowed_methods;
 }
 
-HttpResponse Router::option_response(const HttpRequest& request) {
-    const std::string path = request.get_path();
-    const auto path_it = methods.find(path);
-    if (path_it == methods.end()) {
-        return HttpResponse::option_response(std::vector<HttpMethod>());
-    }
-    std::vector<HttpMethod> allowed_methods;
-    for (const auto& method : path_it->second) {
-        allowed_methods.push_back(method.first);
-    }
-    return HttpResponse::option_response(allowed_methods);
+Priority Router::get_priority(std::string_view request) const {
+    const auto path_it = methods.find(HttpParser::peek_path(request));
+    if (path_it == methods.end()) return Priority::NORMAL;
+    const auto method_it = path_it->second.find(parse_method(HttpParser::peek_method(request)));
+    if (method_it == path_it->second.end()) return Priority::NORMAL;
+    return method_it->second->get_priority();
 }
 
-HttpResponse Router::handle_request(const HttpRequest& http_request) {
-    if (http_request.get_method() == HttpMethod::OPTIONS) {
-        return option_response(http_request);
+Router::Preflight Router::build_preflight(const std::vector<HttpMethod>& allowed_methods) const {
+    HttpResponse response = HttpResponse::option_response(allowed_methods);
+    Preflight preflight;
+    preflight.keep_alive = response.to_string();
+    preflight.close = response.close_connection().to_string();
+    return preflight;
+}
+
+void Router::cache_preflights() {
+    preflights.clear();
+    for (const auto& [path, method_map] : methods) {
+        preflights.emplace(path, build_preflight(get_allowed_methods(path)));
     }
+    unknown_preflight = build_preflight(std::vector<HttpMethod>());
+}
+
+const std::string& Router::preflight(std::string_view path, bool keep_alive) const {
+    const auto found = preflights.find(path);
+    const Preflight& answers = found == preflights.end() ? unknown_preflight : found->second;
+    return keep_alive ? answers.keep_alive : answers.close;
+}
 
+HttpResponse Router::handle_request(const HttpRequest& http_request) {
     auto method_result = get_method(http_request);
     if (method_result.is_err()) {
         return HttpResponse::from_json(
@@ -58,9 +71,18 @@ HttpResponse Router::handle_request(const HttpRequest& http_request) {
     }
 
     const ServerMethodBase* method = method_result.unwrap();
-    auto response = method->handle_request(http_request.get_body());
-    
-    return HttpResponse::from_json(response);
+    // taken before the handler runs, so the tag is never newer than the body
+    std::optional<std::string> etag = method->get_etag();
+    if (etag.has_value()) {
+        auto if_none_match = http_request.get_header("If-None-Match");
+        if (if_none_match.has_value() && HttpParser::matches_etag(*if_none_match, *etag)) {
+            return HttpResponse::not_modified(*etag);
+        }
+    }
+
+    HttpResponse response = HttpResponse::from_json(method->handle_request(http_request.get_body()));
+    if (etag.has_value() && response.get_status_code() == HttpStatusCode::OK) response.add_etag(*etag);
+    return response;
 }
 
 void Router::log_methods() {
@@ -9,9 +9,22 @@
 #include "server/http/server_method.h"
 
 class Router {
+  public:
+    // The bytes of an OPTIONS answer, one for each Connection value.
+    struct Preflight {
+        std::string keep_alive;
+        std::string close;
+    };
+
   private:
-    std::map<std::string, std::map<HttpMethod, std::unique_ptr<ServerMethodBase>>> methods;
+    // transparent, so paths viewed in a request look up without a copy
+    std::map<std::string, std::map<HttpMethod, std::unique_ptr<ServerMethodBase>>, std::less<>> methods;
     Result<const ServerMethodBase*> get_method(const HttpRequest& http_request) const;
+    // built by cache_preflights(), read-only after
+    std::map<std::string, Preflight, std::less<>> preflights;
+    Preflight unknown_preflight;
+
+    Preflight build_preflight(const std::vector<HttpMethod>& allowed_methods) const;
 
   public:
     Router();
@@ -24,7 +37,16 @@ class Router {
     };
     void log_methods();
 
+    // Not for OPTIONS, which preflight() answers. A route with an ETag
+    // answers 304 without running its handler when If-None-Match matches.
     HttpResponse handle_request(const HttpRequest& request);
-    HttpResponse option_response(const HttpRequest& request);
+    // Serialises the OPTIONS answer of every path once the routes are all
+    // added; the server calls it when it starts.
+    void cache_preflights();
+    // The cached OPTIONS answer for path.
+    const std::string& preflight(std::string_view path, bool keep_alive) const;
     std::vector<HttpMethod> get_allowed_methods(const std::string& path) const;
+    // Priority of the route a raw request goes to, NORMAL for unknown routes.
+    // Reads the request line only.
+    Priority get_priority(std::string_view request) const;
 };
\ No newline at end of file
@@ -2,11 +2,14 @@
 
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 #include "server/http/http_enums.h"
 #include "server/http/request_body.h"
+#include "server/server/priority.h"
 #include "server/utils/error.h"
 #include "server/utils/result.h"
 #include "nlohmann/json.hpp"
@@ -16,7 +19,12 @@ class ServerMethodBase {
     virtual ~ServerMethodBase() = default;
     virtual std::string get_path() const = 0;
     virtual HttpMethod get_method() const = 0;
-    virtual Result<nlohmann::json> handle_request(std::string raw_body) const = 0;
+    // Lane the server's pool runs the route's requests in.
+    virtual Priority get_priority() const = 0;
+    // Tag of the current version of what the route answers with, for
+    // conditional requests; nullopt for routes without one.
+    virtual std::optional<std::string> get_etag() const = 0;
+    virtual Result<nlohmann::json> handle_request(std::string_view raw_body) const = 0;
 };
 
 template <typename BodyType>
@@ -28,17 +36,34 @@ class ServerMethod : public ServerMethodBase {
     std::string path;
     HttpMethod method;
     std::function<Result<nlohmann::json>(const BodyType&)> handler;
+    Priority priority;
+    std::function<std::string()> etag;
 
   public:
     ServerMethod(std::string path, HttpMethod method,
-                 std::function<Result<nlohmann::json>(const BodyType&)> handler)
-        : path(std::move(path)), method(method), handler(std::move(handler)) {}
+                 std::function<Result<nlohmann::json>(const BodyType&)> handler,
+                 Priority priority = Priority::NORMAL)
+        : path(std::move(path)), method(method), handler(std::move(handler)), priority(priority) {}
 
     std::string get_path() const override { return path; }
 
     HttpMethod get_method() const override { return method; }
 
-    Result<nlohmann::json> handle_request(std::string raw_body) const override {
+    Priority get_priority() const override { return priority; }
+
+    // The route answers conditional requests with the tag etag returns.
+    ServerMethod with_etag(std::function<std::string()> etag) const {
+        ServerMethod method = *this;
+        method.etag = std::move(etag);
+        return method;
+    }
+
+    std::optional<std::string> get_etag() const override {
+        if (!etag) return std::nullopt;
+        return etag();
+    }
+
+    Result<nlohmann::json> handle_request(std::string_view raw_body) const override {
         nlohmann::json json_body;
         try {
             json_body = nlohmann::json::parse(raw_body);
@@ -48,18 +73,25 @@ class ServerMethod : public ServerMethodBase {
                       HttpStatusCode::BAD_REQUEST));
         }
 
-        auto parse_result = BodyType().validate(json_body);
-        if (parse_result.is_err()) {
-            return Result<nlohmann::json>(parse_result.unwrap_err());
-        }
+        // a field of the wrong type throws from get<> while the body is read
+        try {
+            auto parse_result = BodyType().validate(json_body);
+            if (parse_result.is_err()) {
+                return Result<nlohmann::json>(parse_result.unwrap_err());
+            }
+
+            std::unique_ptr<RequestBody> validated_body = parse_result.unwrap();
+            auto typed_body = dynamic_cast<BodyType*>(validated_body.get());
+            if (typed_body == nullptr) {
+                return Result<nlohmann::json>(
+                    Error("Invalid request body type", HttpStatusCode::BAD_REQUEST));
+            }
 
-        std::unique_ptr<RequestBody> validated_body = parse_result.unwrap();
-        auto typed_body = dynamic_cast<BodyType*>(validated_body.get());
-        if (typed_body == nullptr) {
+            return handler(*typed_body);
+        } catch (const nlohmann::json::exception& e) {
             return Result<nlohmann::json>(
-                Error("Invalid request body type", HttpStatusCode::BAD_REQUEST));
+                Error("Invalid request body: " + std::string(e.what()),
+                      HttpStatusCode::BAD_REQUEST));
         }
-
-        return handler(*typed_body);
     }
 };
\ No newline at end of file
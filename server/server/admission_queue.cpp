@@ -0,0 +1,25 @@
+#include "server/server/admission_queue.h"
+
+#include <algorithm>
+
+AdmissionQueue::AdmissionQueue(double rate, std::size_t burst, std::size_t max_waiting)
+    : interval(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))),
+      burst_window(interval * static_cast<long>(burst)),
+      max_wait(interval * static_cast<long>(max_waiting)),
+      random(std::random_device{}()) {}
+
+std::optional<AdmissionQueue::Clock::time_point> AdmissionQueue::reserve(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // slots further back than the burst are gone
+    Clock::time_point slot = std::max(next_slot, now - burst_window);
+    if (slot - now > max_wait) return std::nullopt;
+    next_slot = slot + interval;
+    return slot;
+}
+
+std::chrono::seconds AdmissionQueue::retry_after(Clock::time_point now, std::chrono::seconds jitter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto backlog = std::chrono::ceil<std::chrono::seconds>(std::max(next_slot - now, Clock::duration::zero()));
+    std::uniform_int_distribution<long> spread(0, std::max<long>(0, jitter.count()));
+    return std::max(std::chrono::seconds(1), backlog + std::chrono::seconds(spread(random)));
+}
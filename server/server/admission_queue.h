@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <random>
+
+// Paces admissions to a steady rate. Every admission reserves the next free
+// slot, one 1/rate apart; a burst can use slots that went unused while it
+// was quiet. Reservations never wait longer than max_waiting slots, so the
+// queue is bounded by time rather than by entries and needs no list of who
+// is waiting. Shared by all reactors of a server.
+class AdmissionQueue {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    AdmissionQueue(double rate, std::size_t burst, std::size_t max_waiting);
+
+    // Time at which the caller may go ahead, now or earlier for right away.
+    // nullopt when the queue is full.
+    std::optional<Clock::time_point> reserve(Clock::time_point now);
+    // When a refused caller should try again: once the queue has drained,
+    // spread over jitter so the retries do not arrive together again.
+    std::chrono::seconds retry_after(Clock::time_point now, std::chrono::seconds jitter);
+
+  private:
+    Clock::duration interval;
+    Clock::duration burst_window;
+    Clock::duration max_wait;
+
+    std::mutex mutex;
+    Clock::time_point next_slot;
+    std::minstd_rand random;
+};
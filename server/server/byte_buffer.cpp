@@ -0,0 +1,104 @@
+#include "server/server/byte_buffer.h"
+
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstring>
+
+std::size_t ByteBuffer::size() const {
+    return write_index - read_index;
+}
+
+bool ByteBuffer::empty() const {
+    return write_index == read_index;
+}
+
+const char* ByteBuffer::data() const {
+    return storage.data() + read_index;
+}
+
+std::string_view ByteBuffer::view() const {
+    return std::string_view(data(), size());
+}
+
+std::size_t ByteBuffer::writable() const {
+    return storage.size() - write_index;
+}
+
+void ByteBuffer::ensure_writable(std::size_t count) {
+    if (writable() >= count) return;
+
+    std::size_t readable = size();
+    // compact in place when the consumed prefix alone makes room and moving
+    // the unread bytes costs no more than what was consumed to free it
+    if (read_index + writable() >= count && read_index >= readable) {
+        std::memmove(storage.data(), storage.data() + read_index, readable);
+    } else {
+        std::vector<char> grown(std::max(storage.size() * 2, readable + count));
+        std::memcpy(grown.data(), storage.data() + read_index, readable);
+        storage.swap(grown);
+    }
+    read_index = 0;
+    write_index = readable;
+}
+
+void ByteBuffer::append(const char* bytes, std::size_t count) {
+    if (count == 0) return;
+    ensure_writable(count);
+    std::memcpy(storage.data() + write_index, bytes, count);
+    write_index += count;
+}
+
+void ByteBuffer::append(std::string_view bytes) {
+    append(bytes.data(), bytes.size());
+}
+
+void ByteBuffer::consume(std::size_t count) {
+    read_index += std::min(count, size());
+    if (read_index == write_index) {
+        read_index = write_index = 0;
+    }
+}
+
+void ByteBuffer::clear() {
+    read_index = write_index = 0;
+}
+
+void ByteBuffer::release() {
+    if (!empty()) return;
+    std::vector<char>().swap(storage);
+    read_index = write_index = 0;
+}
+
+std::size_t ByteBuffer::capacity() const {
+    return storage.capacity();
+}
+
+ssize_t ByteBuffer::read_from(int fd) {
+    int queued = 0;
+    if (ioctl(fd, FIONREAD, &queued) == -1) queued = 0;
+    // no fixed minimum, so a connection that only ever gets a few bytes
+    // keeps a few bytes of storage
+    if (queued > 0) ensure_writable(static_cast<std::size_t>(queued));
+
+    char spill[SPILL_SIZE];
+    struct iovec vectors[2];
+    std::size_t space = writable();
+    vectors[0].iov_base = storage.data() + write_index;
+    vectors[0].iov_len = space;
+    vectors[1].iov_base = spill;
+    vectors[1].iov_len = sizeof(spill);
+
+    ssize_t result = readv(fd, vectors, 2);
+    if (result <= 0) return result;
+
+    std::size_t received = static_cast<std::size_t>(result);
+    if (received <= space) {
+        write_index += received;
+    } else {
+        write_index += space;
+        append(spill, received - space);
+    }
+    return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+// Growable byte buffer with separate read and write offsets. Consuming from
+// the front only moves the read offset; the unread bytes are moved back to
+// the start of the storage only when that is no more work than the bytes
+// already consumed, so appending and consuming are amortised O(1) per byte.
+// Storage is allocated on first use and freed again by release().
+class ByteBuffer {
+  public:
+    ByteBuffer() = default;
+
+    std::size_t size() const;
+    bool empty() const;
+    const char* data() const;
+    std::string_view view() const;
+
+    void append(const char* bytes, std::size_t count);
+    void append(std::string_view bytes);
+    void consume(std::size_t count);
+    void clear();
+    // Frees the storage if nothing is buffered.
+    void release();
+    std::size_t capacity() const;
+
+    // Reads what the socket has queued, sized with the FIONREAD hint. Anything
+    // that arrives beyond the hint spills into a stack buffer through the
+    // second readv vector. Returns the bytes read, 0 on EOF and -1 with errno
+    // set on error.
+    ssize_t read_from(int fd);
+
+  private:
+    static constexpr std::size_t SPILL_SIZE = 65536;
+
+    std::vector<char> storage;
+    std::size_t read_index = 0;
+    std::size_t write_index = 0;
+
+    std::size_t writable() const;
+    void ensure_writable(std::size_t count);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Names one connection rather than its fd. Two connections that get the same
+// fd one after the other differ in generation, so a handle kept past its
+// connection's close cannot reach the next one.
+struct ConnectionHandle {
+    int fd = -1;
+    std::uint32_t generation = 0;
+
+    bool is_valid() const {
+        return fd >= 0;
+    }
+
+    bool operator==(const ConnectionHandle& other) const {
+        return fd == other.fd && generation == other.generation;
+    }
+    bool operator!=(const ConnectionHandle& other) const {
+        return !(*this == other);
+    }
+    bool operator<(const ConnectionHandle& other) const {
+        return fd != other.fd ? fd < other.fd : generation < other.generation;
+    }
+
+    // For epoll_event::data.u64, so stale events are detected too.
+    std::uint64_t pack() const {
+        return (static_cast<std::uint64_t>(generation) << 32) | static_cast<std::uint32_t>(fd);
+    }
+    static ConnectionHandle unpack(std::uint64_t packed) {
+        return ConnectionHandle{static_cast<int>(static_cast<std::uint32_t>(packed)),
+                                static_cast<std::uint32_t>(packed >> 32)};
+    }
+};
+
+template <>
+struct std::hash<ConnectionHandle> {
+    std::size_t operator()(const ConnectionHandle& handle) const {
+        return std::hash<std::uint64_t>()(handle.pack());
+    }
+};
@@ -0,0 +1,129 @@
+#include "server/server/connection_table.h"
+#include "server/utils/logger.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <utility>
+
+ConnectionTable::ConnectionTable() {
+    std::size_t capacity = 1 << 20;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_max != RLIM_INFINITY) {
+        capacity = std::min<std::size_t>(limit.rlim_max, 1 << 24);
+    }
+    page_count = (capacity + PAGE_SIZE - 1) / PAGE_SIZE;
+    pages = std::make_unique<std::atomic<Page*>[]>(page_count);
+    for (std::size_t i = 0; i < page_count; ++i) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+    members.resize(1);
+}
+
+ConnectionTable::~ConnectionTable() {
+    for (std::size_t i = 0; i < page_count; ++i) {
+        delete pages[i].load(std::memory_order_relaxed);
+    }
+}
+
+void ConnectionTable::set_owner_count(std::size_t count) {
+    members.resize(std::max<std::size_t>(1, count));
+}
+
+ConnectionTable::Slot* ConnectionTable::slot(int fd) const {
+    if (fd < 0) return nullptr;
+    std::size_t page = static_cast<std::size_t>(fd) >> PAGE_BITS;
+    if (page >= page_count) return nullptr;
+    Page* slots = pages[page].load(std::memory_order_acquire);
+    if (slots == nullptr) return nullptr;
+    return &(*slots)[static_cast<std::size_t>(fd) & (PAGE_SIZE - 1)];
+}
+
+ConnectionTable::Slot* ConnectionTable::slot_or_allocate(int fd) {
+    if (fd < 0) return nullptr;
+    std::size_t page = static_cast<std::size_t>(fd) >> PAGE_BITS;
+    if (page >= page_count) return nullptr;
+
+    Page* slots = pages[page].load(std::memory_order_acquire);
+    if (slots == nullptr) {
+        // reactors may race to allocate the same page
+        Page* allocated = new Page();
+        if (pages[page].compare_exchange_strong(slots, allocated, std::memory_order_acq_rel)) {
+            slots = allocated;
+        } else {
+            delete allocated;
+        }
+    }
+    return &(*slots)[static_cast<std::size_t>(fd) & (PAGE_SIZE - 1)];
+}
+
+ConnectionHandle ConnectionTable::insert(int owner, TcpSocket socket) {
+    int fd = socket.get_fd();
+    Slot* target = slot_or_allocate(fd);
+    if (target == nullptr) {
+        Logger::instance().error("No connection slot for fd " + std::to_string(fd));
+        return ConnectionHandle{};
+    }
+    std::uint32_t generation = target->generation.load(std::memory_order_relaxed);
+    if (generation % 2 == 1) {
+        Logger::instance().error("Connection slot for fd " + std::to_string(fd) + " is still occupied");
+        return ConnectionHandle{};
+    }
+
+    ConnectionHandle handle{fd, generation + 1};
+    socket.set_handle(handle);
+    target->socket.emplace(std::move(socket));
+    target->owner = owner;
+    target->member_index = members[owner].size();
+    members[owner].push_back(handle);
+    target->generation.store(handle.generation, std::memory_order_release);
+    return handle;
+}
+
+std::optional<TcpSocket> ConnectionTable::remove(ConnectionHandle handle) {
+    Slot* target = slot(handle.fd);
+    if (target == nullptr || target->generation.load(std::memory_order_relaxed) != handle.generation) {
+        return std::nullopt;
+    }
+    // stale before it is emptied
+    target->generation.store(handle.generation + 1, std::memory_order_release);
+
+    auto& owned = members[target->owner];
+    ConnectionHandle moved = owned.back();
+    owned[target->member_index] = moved;
+    slot(moved.fd)->member_index = target->member_index;
+    owned.pop_back();
+
+    std::optional<TcpSocket> socket = std::move(target->socket);
+    target->socket.reset();
+    target->owner = -1;
+    return socket;
+}
+
+TcpSocket* ConnectionTable::find(ConnectionHandle handle) const {
+    Slot* target = slot(handle.fd);
+    if (target == nullptr || target->generation.load(std::memory_order_acquire) != handle.generation) {
+        return nullptr;
+    }
+    return &*target->socket;
+}
+
+TcpSocket* ConnectionTable::find(int fd) const {
+    Slot* target = slot(fd);
+    if (target == nullptr || target->generation.load(std::memory_order_acquire) % 2 == 0) {
+        return nullptr;
+    }
+    return &*target->socket;
+}
+
+std::size_t ConnectionTable::size(int owner) const {
+    return members[owner].size();
+}
+
+std::size_t ConnectionTable::slot_overhead() {
+    return sizeof(Slot) - sizeof(TcpSocket) + sizeof(ConnectionHandle);
+}
+
+std::vector<ConnectionHandle> ConnectionTable::handles(int owner) const {
+    return members[owner];
+}
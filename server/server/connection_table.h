@@ -0,0 +1,78 @@
+#pragma once
+
+#include "server/server/connection_handle.h"
+#include "server/server/tcp_socket.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Connection slots indexed by fd. Slots live in fixed-size pages that are
+// never moved or freed, so a socket keeps its address while it is in the
+// table and lookups are two array indexings. Each slot counts generations,
+// odd while occupied, so handles taken before a close stop resolving.
+//
+// A slot is written only by the reactor that owns its connection, and a slot
+// must be freed before its fd is closed or the fd could be reused while the
+// slot is still occupied. find() may run on any thread for a connection that
+// is known to stay open, as pool jobs are by the deferred close.
+class ConnectionTable {
+  public:
+    ConnectionTable();
+    ~ConnectionTable();
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    // Must be called before the owners start inserting.
+    void set_owner_count(std::size_t count);
+
+    // Returns an invalid handle if the fd is beyond RLIMIT_NOFILE or its
+    // slot is still occupied.
+    ConnectionHandle insert(int owner, TcpSocket socket);
+    // Frees the slot and hands the socket back, still open.
+    std::optional<TcpSocket> remove(ConnectionHandle handle);
+
+    // nullptr for a stale handle.
+    TcpSocket* find(ConnectionHandle handle) const;
+    // The connection currently holding fd, if any.
+    TcpSocket* find(int fd) const;
+
+    std::size_t size(int owner) const;
+    // What a connection costs in the table beyond its TcpSocket.
+    static std::size_t slot_overhead();
+    // Snapshot of the owner's handles, safe to use while removing.
+    std::vector<ConnectionHandle> handles(int owner) const;
+
+    // visit must not insert or remove.
+    template <typename Visit>
+    void for_each(int owner, Visit&& visit) {
+        for (const ConnectionHandle& handle : members[owner]) {
+            visit(*slot(handle.fd)->socket);
+        }
+    }
+
+  private:
+    static constexpr std::size_t PAGE_BITS = 8;
+    static constexpr std::size_t PAGE_SIZE = 1 << PAGE_BITS;
+
+    struct Slot {
+        std::atomic<std::uint32_t> generation{0};
+        int owner = -1;
+        // position in members[owner]
+        std::size_t member_index = 0;
+        std::optional<TcpSocket> socket;
+    };
+    using Page = std::array<Slot, PAGE_SIZE>;
+
+    std::size_t page_count;
+    std::unique_ptr<std::atomic<Page*>[]> pages;
+    // dense list of each owner's connections, for iteration
+    std::vector<std::vector<ConnectionHandle>> members;
+
+    Slot* slot(int fd) const;
+    Slot* slot_or_allocate(int fd);
+};
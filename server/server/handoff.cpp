@@ -0,0 +1,392 @@
+#include "server/server/handoff.h"
+#include "server/utils/logger.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+static Result<int> send_all(int fd, const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) continue;
+        if (sent == -1) return Result<int>(Error("Failed to send handoff payload"));
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return Result<int>(0);
+}
+
+static Result<int> receive_all(int fd, void* data, std::size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = ::recv(fd, bytes, size, 0);
+        if (received == -1 && errno == EINTR) continue;
+        if (received == -1) return Result<int>(Error("Failed to receive handoff payload"));
+        if (received == 0) return Result<int>(Error("Handoff channel closed early"));
+        bytes += received;
+        size -= static_cast<std::size_t>(received);
+    }
+    return Result<int>(0);
+}
+
+// One batch of descriptors, attached to a message carrying their count.
+static Result<int> send_fds(int fd, const int* fds, std::uint32_t count) {
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)] = {};
+    struct iovec vector{&count, sizeof(count)};
+    struct msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+
+    return Result<int>::from_bsd(
+        static_cast<int>(sendmsg(fd, &message, MSG_NOSIGNAL)),
+        "Failed to send handoff descriptors"
+    );
+}
+
+static Result<int> receive_fds(int fd, std::vector<int>& fds) {
+    std::uint32_t count = 0;
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)] = {};
+    struct iovec vector{&count, sizeof(count)};
+    struct msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    if (received == -1) return Result<int>(Error("Failed to receive handoff descriptors"));
+    if (received != sizeof(count) || (message.msg_flags & MSG_CTRUNC)) {
+        return Result<int>(Error("Malformed handoff descriptor batch"));
+    }
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(int) * count)) {
+        return Result<int>(Error("Malformed handoff descriptor batch"));
+    }
+    const int* passed = reinterpret_cast<const int*>(CMSG_DATA(header));
+    fds.insert(fds.end(), passed, passed + count);
+    return Result<int>(static_cast<int>(count));
+}
+
+static nlohmann::json to_binary(const std::string& bytes) {
+    return nlohmann::json::binary(std::vector<std::uint8_t>(bytes.begin(), bytes.end()));
+}
+
+static std::string from_binary(const nlohmann::json& json) {
+    const auto& bytes = json.get_binary();
+    return std::string(bytes.begin(), bytes.end());
+}
+
+static Result<int> unix_socket_address(const std::string& path, struct sockaddr_un& address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return Result<int>(Error("Handoff socket path is too long: " + path));
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return Result<int>(0);
+}
+
+// The payload carries every listener, every WebSocket connection and the TLS
+// ticket keys, so both ends only talk to a process of their own user.
+static Result<int> check_peer(int fd) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1) {
+        return Result<int>(Error("Failed to read handoff peer credentials"));
+    }
+    if (credentials.uid != geteuid()) {
+        return Result<int>(Error("Refusing handoff with pid " + std::to_string(credentials.pid) +
+                                 " of uid " + std::to_string(credentials.uid)));
+    }
+    return Result<int>(0);
+}
+
+// Creates the socket's directory, private to this user, when it is missing,
+// and refuses one that others can write to, where they could put their own
+// socket in its place.
+static Result<int> check_directory(const std::string& path) {
+    std::size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    if (mkdir(directory.c_str(), 0700) == -1 && errno != EEXIST) {
+        return Result<int>(Error("Failed to create handoff directory " + directory));
+    }
+    struct stat info;
+    if (lstat(directory.c_str(), &info) == -1 || !S_ISDIR(info.st_mode)) {
+        return Result<int>(Error("Handoff directory " + directory + " is not a directory"));
+    }
+    if (info.st_uid != geteuid() || (info.st_mode & (S_IWGRP | S_IWOTH))) {
+        // no call failed, mkdir's EEXIST would only mislead
+        errno = 0;
+        return Result<int>(Error("Handoff directory " + directory +
+                                 " has to belong to this user and be writable by it alone"));
+    }
+    return Result<int>(0);
+}
+
+static void set_channel_timeout(int fd) {
+    struct timeval timeout;
+    timeout.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+Handoff::Handoff(std::string path) : path(std::move(path)) {}
+
+Handoff::~Handoff() {
+    stop();
+    if (channel_fd != -1) close(channel_fd);
+}
+
+Result<Handoff::Payload> Handoff::receive() {
+    struct sockaddr_un address;
+    if (unix_socket_address(path, address).is_err()) {
+        return Result<Payload>(Error("Handoff socket path is too long: " + path));
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return Result<Payload>(Error("Failed to create handoff socket"));
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1) {
+        Error error("No running instance to take over from at " + path);
+        close(fd);
+        return Result<Payload>(std::move(error));
+    }
+    auto peer = check_peer(fd);
+    if (peer.is_err()) {
+        Logger::instance().warn(peer.unwrap_err().get_message(false));
+        close(fd);
+        return Result<Payload>(Error("Not taking over from " + path));
+    }
+    set_channel_timeout(fd);
+
+    auto payload = receive_payload(fd);
+    if (payload.is_err()) {
+        close(fd);
+        return payload;
+    }
+    channel_fd = fd;
+    return payload;
+}
+
+void Handoff::acknowledge() {
+    if (channel_fd == -1) return;
+    char ack = 1;
+    send_all(channel_fd, &ack, sizeof(ack)).log_error("Failed to acknowledge handoff");
+    close(channel_fd);
+    channel_fd = -1;
+}
+
+Result<int> Handoff::serve(PrepareCallback prepare, FinishCallback finish) {
+    struct sockaddr_un address;
+    auto address_result = unix_socket_address(path, address);
+    if (address_result.is_err()) return address_result;
+    auto directory_result = check_directory(path);
+    if (directory_result.is_err()) return directory_result;
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) return Result<int>(Error("Failed to create handoff socket"));
+    // left behind by the previous process, which no longer serves it;
+    // anything else at path makes bind fail
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode) && existing.st_uid == geteuid()) {
+        unlink(path.c_str());
+    }
+    auto listen_result = Result<int>::from_bsd(
+        bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)),
+        "Failed to bind handoff socket " + path
+    );
+    // connecting needs write permission, which only the owner keeps; nothing
+    // can connect before listen()
+    if (listen_result.is_ok()) {
+        listen_result = Result<int>::from_bsd(chmod(path.c_str(), 0600), "Failed to restrict handoff socket " + path);
+    }
+    if (listen_result.is_ok()) {
+        listen_result = Result<int>::from_bsd(::listen(listen_fd, 1), "Failed to listen on handoff socket");
+    }
+    if (listen_result.is_err()) {
+        close(listen_fd);
+        listen_fd = -1;
+        return listen_result;
+    }
+
+    serving = true;
+    thread = std::thread(&Handoff::serve_loop, this, std::move(prepare), std::move(finish));
+    return Result<int>(listen_fd);
+}
+
+void Handoff::stop() {
+    if (serving.exchange(false)) {
+        // wakes the blocking accept
+        shutdown(listen_fd, SHUT_RDWR);
+        unlink(path.c_str());
+    }
+    if (thread.joinable()) thread.join();
+    if (listen_fd != -1) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+void Handoff::serve_loop(PrepareCallback prepare, FinishCallback finish) {
+    Logger& logger = Logger::instance();
+    while (serving) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (serving) logger.error(Error("Failed to accept handoff connection"));
+            return;
+        }
+        auto peer = check_peer(fd);
+        if (peer.is_err()) {
+            logger.warn(peer.unwrap_err().get_message(false));
+            close(fd);
+            continue;
+        }
+        set_channel_timeout(fd);
+
+        logger.info("Handing off to a new process");
+        Payload payload = prepare();
+        bool acknowledged = send_payload(fd, payload).log_error().is_ok() && wait_for_ack(fd);
+        close(fd);
+
+        if (!acknowledged) {
+            logger.error("Handoff was not acknowledged, resuming service");
+            finish(false, payload);
+            continue;
+        }
+        // the successor has its own copies now; ours would keep the peers'
+        // connections open after the successor closes them
+        for (auto& server : payload.servers) {
+            for (auto& connection : server.connections) {
+                close(connection.fd);
+            }
+        }
+        // the path belongs to the successor from here on, so it is not unlinked
+        serving = false;
+        logger.info("Handoff acknowledged");
+        finish(true, payload);
+        return;
+    }
+}
+
+Result<int> Handoff::send_payload(int fd, const Payload& payload) {
+    std::vector<int> fds;
+    nlohmann::json servers = nlohmann::json::array();
+    for (const auto& server : payload.servers) {
+        nlohmann::json connections = nlohmann::json::array();
+        for (const auto& connection : server.connections) {
+            connections.push_back({
+                {"phase", static_cast<int>(connection.phase)},
+                {"flags", connection.flags},
+                {"unread", to_binary(connection.unread)},
+                {"unsent", to_binary(connection.unsent)},
+            });
+        }
+        servers.push_back({{"listeners", server.listeners.size()}, {"connections", connections}});
+        fds.insert(fds.end(), server.listeners.begin(), server.listeners.end());
+        for (const auto& connection : server.connections) {
+            fds.push_back(connection.fd);
+        }
+    }
+
+    nlohmann::json document = {
+        {"state", payload.state},
+        {"servers", servers},
+        {"fds", fds.size()},
+        {"tls_ticket_keys", to_binary(payload.tls_ticket_keys)},
+    };
+    std::vector<std::uint8_t> bytes = nlohmann::json::to_cbor(document);
+    std::uint32_t length = static_cast<std::uint32_t>(bytes.size());
+
+    auto result = send_all(fd, &length, sizeof(length))
+        .chain<int>([&](int) { return send_all(fd, bytes.data(), bytes.size()); });
+    for (std::size_t sent = 0; sent < fds.size() && result.is_ok();) {
+        std::size_t batch = std::min<std::size_t>(HANDOFF_FDS_PER_MESSAGE, fds.size() - sent);
+        result = send_fds(fd, fds.data() + sent, static_cast<std::uint32_t>(batch));
+        sent += batch;
+    }
+    return result;
+}
+
+Result<Handoff::Payload> Handoff::receive_payload(int fd) {
+    std::uint32_t length = 0;
+    if (receive_all(fd, &length, sizeof(length)).log_error().is_err()) {
+        return Result<Payload>(Error("Failed to receive handoff payload"));
+    }
+    std::vector<std::uint8_t> bytes(length);
+    if (receive_all(fd, bytes.data(), bytes.size()).log_error().is_err()) {
+        return Result<Payload>(Error("Failed to receive handoff payload"));
+    }
+
+    nlohmann::json document = nlohmann::json::from_cbor(bytes, true, false);
+    if (document.is_discarded() || !document.contains("fds") || !document.contains("servers")) {
+        return Result<Payload>(Error("Malformed handoff payload"));
+    }
+
+    // every field past the two checked above may be missing or of the wrong
+    // type, and a bad payload must not leak the descriptors received with it
+    std::vector<int> fds;
+    try {
+        std::size_t expected = document.at("fds").get<std::size_t>();
+        while (fds.size() < expected) {
+            if (receive_fds(fd, fds).log_error().is_err()) {
+                for (int received : fds) close(received);
+                return Result<Payload>(Error("Failed to receive handoff descriptors"));
+            }
+        }
+
+        Payload payload;
+        payload.state = document.at("state");
+        if (document.contains("tls_ticket_keys")) {
+            payload.tls_ticket_keys = from_binary(document.at("tls_ticket_keys"));
+        }
+        std::size_t next_fd = 0;
+        for (const auto& server : document.at("servers")) {
+            ServerState state;
+            std::size_t listeners = server.at("listeners").get<std::size_t>();
+            for (std::size_t i = 0; i < listeners; ++i) {
+                state.listeners.push_back(fds.at(next_fd++));
+            }
+            for (const auto& connection : server.at("connections")) {
+                state.connections.push_back(TcpServer::DetachedConnection{
+                    fds.at(next_fd++),
+                    static_cast<ConnectionPhase>(connection.at("phase").get<int>()),
+                    connection.at("flags").get<std::uint8_t>(),
+                    from_binary(connection.at("unread")),
+                    from_binary(connection.at("unsent")),
+                });
+            }
+            payload.servers.push_back(std::move(state));
+        }
+        return Result<Payload>(std::move(payload));
+    } catch (const std::exception& e) {
+        for (int received : fds) close(received);
+        return Result<Payload>(Error("Malformed handoff payload: " + std::string(e.what())));
+    }
+}
+
+bool Handoff::wait_for_ack(int fd) {
+    struct pollfd channel{fd, POLLIN, 0};
+    if (poll(&channel, 1, HANDOFF_TIMEOUT_MS) != 1) return false;
+    char ack = 0;
+    return ::recv(fd, &ack, sizeof(ack), 0) == 1 && ack == 1;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+#include "server/server/tcp_server.h"
+#include "server/utils/result.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#define HANDOFF_FDS_PER_MESSAGE 200
+#define HANDOFF_TIMEOUT_MS 10000
+
+// Moves the listening sockets, open connections and application state of a
+// running process to its replacement over a Unix socket. The running process
+// serves the socket; a new process that finds it served takes everything
+// over instead of starting empty. Descriptors travel as SCM_RIGHTS, the rest
+// as one CBOR document. The socket sits in a directory private to the user,
+// and either end hangs up on a peer of another uid.
+class Handoff {
+  public:
+    struct ServerState {
+        std::vector<int> listeners;
+        std::vector<TcpServer::DetachedConnection> connections;
+    };
+
+    struct Payload {
+        nlohmann::json state;
+        std::vector<ServerState> servers;
+        // empty without TLS
+        std::string tls_ticket_keys;
+    };
+
+    // Called on the serving thread. prepare builds the payload once a
+    // successor connects; finish learns whether the successor acknowledged
+    // it and otherwise gets it back to resume serving.
+    using PrepareCallback = std::function<Payload()>;
+    using FinishCallback = std::function<void(bool acknowledged, Payload& payload)>;
+
+    explicit Handoff(std::string path);
+    ~Handoff();
+    Handoff(const Handoff&) = delete;
+    Handoff& operator=(const Handoff&) = delete;
+
+    // New process: takes the payload over from the process serving the
+    // path. Fails when nobody serves it, which is the normal cold start.
+    Result<Payload> receive();
+    // Tells the previous process its payload was taken over.
+    void acknowledge();
+
+    // Running process: waits for a successor on a background thread.
+    Result<int> serve(PrepareCallback prepare, FinishCallback finish);
+    void stop();
+
+  private:
+    std::string path;
+    int listen_fd = -1;
+    // connection to the previous process between receive() and acknowledge()
+    int channel_fd = -1;
+    std::thread thread;
+    std::atomic<bool> serving{false};
+
+    void serve_loop(PrepareCallback prepare, FinishCallback finish);
+    static Result<int> send_payload(int fd, const Payload& payload);
+    static Result<Payload> receive_payload(int fd);
+    static bool wait_for_ack(int fd);
+};
@@ -0,0 +1,250 @@
+#include "server/server/io_uring.h"
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    if (buffers != nullptr) munmap(buffers, buffers_size);
+    if (sqes != nullptr) munmap(sqes, sqes_size);
+    if (cq_ring != nullptr && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    if (sq_ring != nullptr) munmap(sq_ring, sq_ring_size);
+    if (ring_fd != -1) ::close(ring_fd);
+
+    buffers = nullptr;
+    sqes = nullptr;
+    cq_ring = nullptr;
+    sq_ring = nullptr;
+    ring_fd = -1;
+}
+
+Result<int> IoUring::setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd == -1 && errno == EINVAL) {
+        // older kernel without the task-run flags
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+    if (ring_fd == -1) {
+        return Result<int>(Error("Failed to set up io_uring"));
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        release();
+        return Result<int>(Error("io_uring lacks IORING_FEAT_EXT_ARG, kernel 5.11 or newer is needed"));
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        release();
+        return Result<int>(Error("Failed to map io_uring submission ring"));
+    }
+    cq_ring = single_mmap ? sq_ring
+                          : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+        cq_ring = nullptr;
+        release();
+        return Result<int>(Error("Failed to map io_uring completion ring"));
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_memory = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring_fd, IORING_OFF_SQES);
+    if (sqes_memory == MAP_FAILED) {
+        release();
+        return Result<int>(Error("Failed to map io_uring submission entries"));
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_memory);
+
+    char* sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+
+    char* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return Result<int>(ring_fd);
+}
+
+Result<int> IoUring::setup_buffers(unsigned count, unsigned size) {
+    buffers_size = static_cast<std::size_t>(count) * size;
+    void* buffer_memory = mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_memory == MAP_FAILED) {
+        return Result<int>(Error("Failed to allocate io_uring receive buffers"));
+    }
+    buffers = static_cast<char*>(buffer_memory);
+    buffer_size = size;
+
+    // provide the whole pool synchronously so an unsupported kernel is caught here
+    prepare_provide_buffers(0, count);
+    int result = enter(pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    pending = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (result == -1) {
+        return Result<int>(Error("Failed to provide io_uring receive buffers"));
+    }
+
+    unsigned head = *cq_head;
+    int provided = cqes[head & cq_mask].res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    if (provided < 0) {
+        errno = -provided;
+        return Result<int>(Error("Failed to provide io_uring receive buffers"));
+    }
+    return Result<int>(provided);
+}
+
+io_uring_sqe* IoUring::next_sqe() {
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        // ring is full, hand what we have to the kernel first
+        enter(pending, 0, 0, nullptr, 0);
+        pending = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    unsigned index = tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    return sqe;
+}
+
+static void publish(unsigned* sq_tail, unsigned& pending) {
+    __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+    ++pending;
+}
+
+void IoUring::prepare_multishot_accept(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    publish(sq_tail, pending);
+}
+
+void IoUring::prepare_multishot_recv(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = user_data;
+    publish(sq_tail, pending);
+}
+
+void IoUring::prepare_multishot_poll(int fd, std::uint64_t user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    publish(sq_tail, pending);
+}
+
+void IoUring::prepare_send(int fd, const char* data, std::size_t size, std::uint64_t user_data, bool link) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(data);
+    sqe->len = static_cast<std::uint32_t>(size);
+    // MSG_WAITALL makes the kernel retry short sends, so a chain only breaks on errors
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = user_data;
+    publish(sq_tail, pending);
+}
+
+void IoUring::prepare_cancel(std::uint64_t target_user_data) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target_user_data;
+    sqe->user_data = INTERNAL_USER_DATA;
+    publish(sq_tail, pending);
+}
+
+void IoUring::prepare_provide_buffers(std::uint16_t first_id, unsigned count) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<std::uint64_t>(buffers + static_cast<std::size_t>(first_id) * buffer_size);
+    sqe->len = buffer_size;
+    sqe->off = first_id;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = INTERNAL_USER_DATA;
+    publish(sq_tail, pending);
+}
+
+int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, std::size_t arg_size) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_size)
+    );
+}
+
+Result<int> IoUring::submit_and_wait(std::optional<std::chrono::milliseconds> timeout) {
+    int result;
+    if (timeout.has_value()) {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout->count() / 1000;
+        ts.tv_nsec = (timeout->count() % 1000) * 1000000;
+
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+        result = enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    } else {
+        result = enter(pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+    // whatever the kernel did not consume is submitted again next time
+    pending = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+    if (result == -1 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return Result<int>(Error("Failed to wait for io_uring completions"));
+    }
+    return Result<int>(std::max(result, 0));
+}
+
+std::optional<std::uint16_t> IoUring::buffer_id(std::uint32_t flags) {
+    if (!(flags & IORING_CQE_F_BUFFER)) return std::nullopt;
+    return static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+const char* IoUring::buffer_data(std::uint16_t id) const {
+    return buffers + static_cast<std::size_t>(id) * buffer_size;
+}
+
+void IoUring::recycle_buffer(std::uint16_t id) {
+    prepare_provide_buffers(id, 1);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "server/utils/result.h"
+
+#include <linux/io_uring.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Thin wrapper over the raw io_uring syscalls, so no liburing is needed.
+// Owns one submission/completion ring pair and a pool of provided buffers
+// that multishot receives pick from. Buffers are handed to the kernel with
+// IORING_OP_PROVIDE_BUFFERS and go back piggybacked on the next submission.
+// Not thread safe; a ring is created and driven by the reactor thread that
+// owns it.
+class IoUring {
+  public:
+    struct Completion {
+        std::uint64_t user_data;
+        int result;
+        std::uint32_t flags;
+    };
+
+    static constexpr std::uint16_t BUFFER_GROUP = 0;
+    // user_data of operations the wrapper issues itself; their completions
+    // are consumed internally and never reach for_each_completion handlers
+    static constexpr std::uint64_t INTERNAL_USER_DATA = ~0ull;
+
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    Result<int> setup(unsigned entries);
+    // Provides buffer_count buffers of buffer_size bytes under BUFFER_GROUP.
+    Result<int> setup_buffers(unsigned buffer_count, unsigned buffer_size);
+
+    void prepare_multishot_accept(int fd, std::uint64_t user_data);
+    void prepare_multishot_recv(int fd, std::uint64_t user_data);
+    void prepare_multishot_poll(int fd, std::uint64_t user_data);
+    // With link set the next prepared operation only starts once this send
+    // has completed in full.
+    void prepare_send(int fd, const char* data, std::size_t size, std::uint64_t user_data, bool link);
+    void prepare_cancel(std::uint64_t target_user_data);
+
+    // Submits everything prepared so far and waits for at least one
+    // completion or until timeout has passed. nullopt waits without limit.
+    Result<int> submit_and_wait(std::optional<std::chrono::milliseconds> timeout);
+
+    // Whether completions are waiting. With COOP_TASKRUN the kernel posts
+    // them on the next io_uring_enter, so a poll is submit_and_wait(0ms).
+    bool has_completions() const {
+      return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    // Pops every available completion into handler. The completion slot is
+    // released before handler runs, so handler may prepare new operations.
+    template <typename Handler>
+    unsigned for_each_completion(Handler&& handler);
+
+    // Buffer picked by a completion flagged with IORING_CQE_F_BUFFER.
+    static std::optional<std::uint16_t> buffer_id(std::uint32_t flags);
+    const char* buffer_data(std::uint16_t buffer_id) const;
+    // Gives the buffer back to the kernel with the next submission.
+    void recycle_buffer(std::uint16_t buffer_id);
+
+  private:
+    int ring_fd = -1;
+
+    void* sq_ring = nullptr;
+    std::size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    std::size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sqes_size = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    // prepared but not yet handed to the kernel
+    unsigned pending = 0;
+
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    char* buffers = nullptr;
+    std::size_t buffers_size = 0;
+    unsigned buffer_size = 0;
+
+    io_uring_sqe* next_sqe();
+    void prepare_provide_buffers(std::uint16_t first_id, unsigned count);
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, std::size_t arg_size);
+    void release();
+};
+
+template <typename Handler>
+unsigned IoUring::for_each_completion(Handler&& handler) {
+    unsigned seen = 0;
+    while (true) {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return seen;
+
+        const io_uring_cqe& cqe = cqes[head & cq_mask];
+        Completion completion{cqe.user_data, cqe.res, cqe.flags};
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        if (completion.user_data == INTERNAL_USER_DATA) continue;
+        ++seen;
+        handler(completion);
+    }
+}
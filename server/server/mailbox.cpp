@@ -0,0 +1,50 @@
+#include "server/server/mailbox.h"
+#include "server/utils/logger.h"
+
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+Mailbox::~Mailbox() {
+    if (event_fd != -1) close(event_fd);
+}
+
+Result<int> Mailbox::open() {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return Result<int>::from_bsd(event_fd, "Failed to create mailbox eventfd");
+}
+
+int Mailbox::get_fd() const {
+    return event_fd;
+}
+
+void Mailbox::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    if (signalled.exchange(true)) return;
+
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        Logger::instance().error(Error("Failed to signal mailbox"));
+    }
+}
+
+std::size_t Mailbox::drain() {
+    uint64_t counter;
+    while (read(event_fd, &counter, sizeof(counter)) > 0) {}
+    // cleared before the swap: a task posted after the swap signals again
+    signalled.store(false);
+
+    std::vector<Task> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(tasks);
+    }
+    for (auto& task : batch) {
+        task();
+    }
+    return batch.size();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "server/utils/result.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Multi-producer single-consumer queue of closures for one event loop. Any
+// thread may post; the loop watches get_fd() and runs everything posted so
+// far in one drain() per wakeup. Only the post that finds the mailbox
+// unsignalled writes the eventfd, so a burst of posts costs one wakeup.
+class Mailbox {
+  public:
+    using Task = std::function<void()>;
+
+    Mailbox() = default;
+    ~Mailbox();
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    Result<int> open();
+    int get_fd() const;
+
+    void post(Task task);
+    // Runs on the loop thread. Returns the number of tasks that ran; tasks
+    // they post in turn run on the next wakeup.
+    std::size_t drain();
+
+  private:
+    int event_fd = -1;
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    std::atomic<bool> signalled{false};
+};
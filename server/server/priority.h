@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Scheduling class of a message handed to the thread pool: the pool takes
+// HIGH work ahead of NORMAL work, see ThreadPool.
+enum class Priority : std::uint8_t {
+  HIGH,
+  NORMAL,
+};
+
+constexpr std::size_t PRIORITY_COUNT = 2;
+
+inline std::string priority_to_string(Priority priority) {
+  return priority == Priority::HIGH ? "high" : "normal";
+}
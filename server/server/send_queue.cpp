@@ -0,0 +1,217 @@
+#include "server/server/send_queue.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+SendQueue::SendQueue(const SendQueue& other)
+    : chunks(other.chunks),
+      head(other.head),
+      front_offset(other.front_offset),
+      bytes(other.bytes),
+      zerocopy(other.zerocopy ? std::make_unique<Zerocopy>(*other.zerocopy) : nullptr) {}
+
+SendQueue& SendQueue::operator=(const SendQueue& other) {
+    if (this != &other) *this = SendQueue(other);
+    return *this;
+}
+
+std::size_t SendQueue::size() const {
+    return bytes;
+}
+
+bool SendQueue::empty() const {
+    return bytes == 0;
+}
+
+void SendQueue::push(std::string data) {
+    if (data.empty()) return;
+    bytes += data.size();
+    if (head < chunks.size() && !chunks.back().shared &&
+        chunks.back().bytes.size() + data.size() <= COALESCE_LIMIT) {
+        chunks.back().bytes.append(data);
+        return;
+    }
+    chunks.push_back(Chunk{std::move(data), nullptr});
+}
+
+void SendQueue::push(std::shared_ptr<const std::string> data) {
+    if (!data || data->empty()) return;
+    // small ones are cheaper copied and packed with their neighbours
+    if (data->size() < COALESCE_LIMIT) {
+        push(*data);
+        return;
+    }
+    bytes += data->size();
+    chunks.push_back(Chunk{std::string(), std::move(data)});
+}
+
+void SendQueue::push_front(std::string data) {
+    if (data.empty()) return;
+    if (head < chunks.size() && front_offset > 0) {
+        chunks[head] = Chunk{std::string(chunks[head].view().substr(front_offset)), nullptr};
+        front_offset = 0;
+    }
+    bytes += data.size();
+    if (head > 0) {
+        chunks[--head] = Chunk{std::move(data), nullptr};
+        return;
+    }
+    chunks.insert(chunks.begin(), Chunk{std::move(data), nullptr});
+}
+
+std::vector<std::string> SendQueue::take() {
+    std::vector<std::string> taken;
+    taken.reserve(chunks.size() - head);
+    for (std::size_t i = head; i < chunks.size(); ++i) {
+        Chunk& chunk = chunks[i];
+        taken.push_back(chunk.shared ? std::string(*chunk.shared) : std::move(chunk.bytes));
+    }
+    if (!taken.empty() && front_offset > 0) {
+        taken.front().erase(0, front_offset);
+    }
+    clear();
+    return taken;
+}
+
+void SendQueue::clear() {
+    chunks.clear();
+    head = 0;
+    front_offset = 0;
+    bytes = 0;
+}
+
+void SendQueue::release() {
+    if (!empty()) return;
+    std::vector<Chunk>().swap(chunks);
+    head = 0;
+}
+
+// Shared buffers are left out, they are not this queue's alone.
+std::size_t SendQueue::capacity() const {
+    std::size_t total = chunks.capacity() * sizeof(Chunk);
+    for (std::size_t i = head; i < chunks.size(); ++i) {
+        total += chunks[i].bytes.capacity();
+    }
+    if (zerocopy) {
+        total += sizeof(Zerocopy) + zerocopy->in_flight.capacity() * sizeof(ZerocopySend);
+    }
+    return total;
+}
+
+std::string_view SendQueue::front() const {
+    if (head == chunks.size()) return std::string_view();
+    return chunks[head].view().substr(front_offset);
+}
+
+void SendQueue::consume(std::size_t count) {
+    bytes -= count;
+    while (count > 0) {
+        std::size_t left_in_front = chunks[head].size() - front_offset;
+        if (count < left_in_front) {
+            front_offset += count;
+            return;
+        }
+        count -= left_in_front;
+        // the sent chunk's memory goes now, the slot when the queue empties
+        chunks[head] = Chunk();
+        ++head;
+        front_offset = 0;
+    }
+    if (head == chunks.size()) {
+        chunks.clear();
+        head = 0;
+    } else if (head * 2 >= chunks.size()) {
+        // a queue that never drains must not grow by its sent prefix
+        chunks.erase(chunks.begin(), chunks.begin() + head);
+        head = 0;
+    }
+}
+
+// A zerocopy send carries only buffers that outlive it, so a write stops
+// where the queue switches between those and the rest.
+ssize_t SendQueue::write_to(int fd) {
+    struct iovec vectors[MAX_IOVECS];
+    bool zerocopy_send = sends_zerocopy(chunks[head]);
+    std::size_t count = 0;
+    for (std::size_t i = head; i < chunks.size() && count < MAX_IOVECS; ++i, ++count) {
+        const Chunk& chunk = chunks[i];
+        if (sends_zerocopy(chunk) != zerocopy_send) break;
+        std::string_view data = chunk.view().substr(count == 0 ? front_offset : 0);
+        vectors[count].iov_base = const_cast<char*>(data.data());
+        vectors[count].iov_len = data.size();
+    }
+
+    struct msghdr message = {};
+    message.msg_iov = vectors;
+    message.msg_iovlen = count;
+    ssize_t result = sendmsg(fd, &message, MSG_NOSIGNAL | (zerocopy_send ? MSG_ZEROCOPY : 0));
+    if (result < 0 && zerocopy_send && errno == ENOBUFS) {
+        // out of the socket's option memory the notifications are kept in
+        zerocopy_send = false;
+        result = sendmsg(fd, &message, MSG_NOSIGNAL);
+    }
+    if (result > 0) {
+        if (zerocopy_send) hold_zerocopy(static_cast<std::size_t>(result));
+        consume(static_cast<std::size_t>(result));
+    }
+    return result;
+}
+
+void SendQueue::enable_zerocopy(std::size_t threshold) {
+    if (!zerocopy) zerocopy = std::make_unique<Zerocopy>();
+    zerocopy->threshold = threshold;
+    zerocopy->enabled = true;
+}
+
+void SendQueue::disable_zerocopy() {
+    if (zerocopy) zerocopy->enabled = false;
+}
+
+bool SendQueue::is_zerocopy_enabled() const {
+    return zerocopy && zerocopy->enabled;
+}
+
+std::size_t SendQueue::complete_zerocopy(std::uint32_t first, std::uint32_t last) {
+    if (!zerocopy) return 0;
+    auto& in_flight = zerocopy->in_flight;
+    // ids wrap around, the range is taken modulo 2^32
+    auto completed = std::remove_if(in_flight.begin(), in_flight.end(), [&](const ZerocopySend& send) {
+        return static_cast<std::uint32_t>(send.id - first) <= static_cast<std::uint32_t>(last - first);
+    });
+    in_flight.erase(completed, in_flight.end());
+    if (in_flight.empty()) std::vector<ZerocopySend>().swap(in_flight);
+    return static_cast<std::size_t>(last - first) + 1;
+}
+
+bool SendQueue::has_zerocopy_in_flight() const {
+    return zerocopy && !zerocopy->in_flight.empty();
+}
+
+std::vector<std::shared_ptr<const std::string>> SendQueue::take_zerocopy_in_flight() {
+    std::vector<std::shared_ptr<const std::string>> buffers;
+    if (!zerocopy) return buffers;
+    for (auto& send : zerocopy->in_flight) {
+        buffers.push_back(std::move(send.buffer));
+    }
+    std::vector<ZerocopySend>().swap(zerocopy->in_flight);
+    return buffers;
+}
+
+bool SendQueue::sends_zerocopy(const Chunk& chunk) const {
+    return chunk.shared && zerocopy && zerocopy->enabled && chunk.shared->size() >= zerocopy->threshold;
+}
+
+void SendQueue::hold_zerocopy(std::size_t count) {
+    std::uint32_t id = zerocopy->next_id++;
+    std::size_t offset = front_offset;
+    for (std::size_t i = head; i < chunks.size() && count > 0; ++i) {
+        std::size_t taken = std::min(count, chunks[i].size() - offset);
+        zerocopy->in_flight.push_back(ZerocopySend{id, chunks[i].shared});
+        count -= taken;
+        offset = 0;
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+// Per-connection output queue. Payloads are queued as separate chunks
+// instead of being copied into one buffer, except that small payloads are
+// packed into the last chunk so a burst of tiny frames still goes out as a
+// few large iovecs. write_to() hands up to MAX_IOVECS chunks to the kernel
+// per call and keeps whatever it did not accept. Chunks sit in a vector
+// consumed from a moving head rather than a deque, which would allocate for
+// every connection up front.
+//
+// Large payloads pushed as shared buffers are queued by reference, so a
+// broadcast is held once however many queues it sits in. With zerocopy on,
+// the kernel sends shared buffers of at least the threshold straight from
+// their pages (MSG_ZEROCOPY); such a buffer stays referenced until the
+// completion covering its send has been reaped from the socket's error
+// queue, see complete_zerocopy().
+class SendQueue {
+  public:
+    SendQueue() = default;
+    // sockets are copied out of Results, zerocopy state included
+    SendQueue(const SendQueue& other);
+    SendQueue& operator=(const SendQueue& other);
+    SendQueue(SendQueue&& other) noexcept = default;
+    SendQueue& operator=(SendQueue&& other) noexcept = default;
+
+    std::size_t size() const;
+    bool empty() const;
+
+    void push(std::string bytes);
+    void push(std::shared_ptr<const std::string> bytes);
+    // Queues bytes ahead of everything else, used to give back bytes that
+    // were taken with take() but not sent.
+    void push_front(std::string bytes);
+    // Moves every queued chunk out, the first one trimmed to its unsent part.
+    // Shared buffers are copied.
+    std::vector<std::string> take();
+    void clear();
+    // Frees the chunk storage if nothing is queued.
+    void release();
+    std::size_t capacity() const;
+
+    // Writes with sendmsg, which is writev with MSG_NOSIGNAL. Returns the
+    // bytes written or -1 with errno set, EAGAIN included.
+    ssize_t write_to(int fd);
+    // Unsent part of the front chunk and the bytes a writer other than
+    // write_to() took from it, for TLS which encrypts a chunk at a time.
+    std::string_view front() const;
+    void consume(std::size_t count);
+
+    // Shared buffers of at least threshold bytes go out with MSG_ZEROCOPY
+    // from now on; SO_ZEROCOPY must be set on the socket.
+    void enable_zerocopy(std::size_t threshold);
+    // Sends after this are copied again. Completions still pending arrive
+    // as before.
+    void disable_zerocopy();
+    bool is_zerocopy_enabled() const;
+    // Releases the buffers of zerocopy sends first through last, the
+    // inclusive range of a kernel notification. Returns the sends released.
+    std::size_t complete_zerocopy(std::uint32_t first, std::uint32_t last);
+    bool has_zerocopy_in_flight() const;
+    // Moves out the buffers of zerocopy sends not completed yet, for a
+    // socket that goes away before their notifications arrive.
+    std::vector<std::shared_ptr<const std::string>> take_zerocopy_in_flight();
+
+  private:
+    static constexpr std::size_t MAX_IOVECS = 64;
+    static constexpr std::size_t COALESCE_LIMIT = 16384;
+
+    struct Chunk {
+        std::string bytes;
+        // set instead of bytes for a buffer other queues may hold as well
+        std::shared_ptr<const std::string> shared;
+
+        std::string_view view() const {
+          return shared ? std::string_view(*shared) : std::string_view(bytes);
+        }
+        std::size_t size() const {
+          return shared ? shared->size() : bytes.size();
+        }
+    };
+
+    // A buffer the kernel may still read from, until notification id is in.
+    struct ZerocopySend {
+        std::uint32_t id;
+        std::shared_ptr<const std::string> buffer;
+    };
+
+    // Allocated by enable_zerocopy(), so queues without it stay small.
+    struct Zerocopy {
+        std::size_t threshold;
+        bool enabled = true;
+        // the kernel numbers zerocopy sends per socket, from zero
+        std::uint32_t next_id = 0;
+        std::vector<ZerocopySend> in_flight;
+    };
+
+    std::vector<Chunk> chunks;
+    // index of the front chunk, the ones before it were sent
+    std::size_t head = 0;
+    // bytes of the front chunk that were already written
+    std::size_t front_offset = 0;
+    std::size_t bytes = 0;
+    std::unique_ptr<Zerocopy> zerocopy;
+
+    bool sends_zerocopy(const Chunk& chunk) const;
+    // Keeps the buffers of the chunks the last sendmsg took count bytes of.
+    void hold_zerocopy(std::size_t count);
+};
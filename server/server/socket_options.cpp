@@ -0,0 +1,31 @@
+#include "server/server/socket_options.h"
+
+namespace {
+
+void describe(std::string& out, const char* name, const std::optional<int>& value) {
+    if (!value.has_value()) return;
+    out += (out.empty() ? "" : ", ") + std::string(name) + "=" + std::to_string(*value);
+}
+
+void describe(std::string& out, const char* name, const std::optional<bool>& value) {
+    if (!value.has_value()) return;
+    out += (out.empty() ? "" : ", ") + std::string(name) + "=" + (*value ? "on" : "off");
+}
+
+}  // namespace
+
+std::string SocketOptions::to_string() const {
+    std::string out;
+    describe(out, "tcp_nodelay", tcp_nodelay);
+    describe(out, "defer_accept", defer_accept_seconds);
+    describe(out, "fastopen_queue", fastopen_queue);
+    describe(out, "receive_buffer", receive_buffer);
+    describe(out, "send_buffer", send_buffer);
+    describe(out, "notsent_lowat", notsent_lowat);
+    describe(out, "busy_poll", busy_poll_us);
+    describe(out, "keepalive", keepalive);
+    describe(out, "keepalive_idle", keepalive_idle_seconds);
+    describe(out, "keepalive_interval", keepalive_interval_seconds);
+    describe(out, "keepalive_probes", keepalive_probes);
+    return out.empty() ? "kernel defaults" : out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+// Tuning applied to a listening socket. Connections accepted from it
+// inherit every one of these on Linux, so accepting costs no extra
+// syscalls. Options left unset keep the kernel's defaults.
+struct SocketOptions {
+    // disables Nagle, for small frames that must not wait for an ACK
+    std::optional<bool> tcp_nodelay;
+    // accept only once the first data arrived, waiting at most this long
+    std::optional<int> defer_accept_seconds;
+    // pending TCP Fast Open requests, 0 disables it
+    std::optional<int> fastopen_queue;
+    std::optional<int> receive_buffer;
+    std::optional<int> send_buffer;
+    // unsent bytes past which the socket stops reporting writable
+    std::optional<int> notsent_lowat;
+    // microseconds to busy poll the device queue on blocking reads
+    std::optional<int> busy_poll_us;
+    std::optional<bool> keepalive;
+    std::optional<int> keepalive_idle_seconds;
+    std::optional<int> keepalive_interval_seconds;
+    std::optional<int> keepalive_probes;
+
+    std::string to_string() const;
+};
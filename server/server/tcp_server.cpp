@@ -4,20 +4,24 @@
 #include <chrono>
 #include <sys/epoll.h>
 #include <cerrno>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <future>
+#include <memory>
 #include <unistd.h>
 #include <vector>
 
 TcpServer::TcpServer()
     :
-      thread_pool(10, [this](TcpSocket& client) { }),
       client_timeout(std::chrono::seconds(30)),
-      epoll_fd(epoll_create1(0))
+      thread_pool(10, [this](ConnectionHandle client, std::string message) {
+          handle_job(client, std::move(message));
+      })
     {
-        if (epoll_fd == -1) {
-            logger.error(Error(std::string("Failed to create epoll instance")));
-            std::runtime_error("Failed to create epoll instance");
-        }
-
     }
 
 TcpServer::~TcpServer() {
@@ -27,76 +31,295 @@ TcpServer::~TcpServer() {
 
 void TcpServer::start(int port, std::string address) {
     Logger& logger = Logger::instance();
-    server_socket.listen(address, port)
-        .finally<void*>([&]() {
-            logger.info("Listening for incoming connections...");
-            return nullptr;
-        });
+    const int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!inherited_listeners.empty() && inherited_listeners.size() != reactor_count) {
+        logger.warn("Running " + std::to_string(inherited_listeners.size()) +
+                    " reactors to serve every inherited listener instead of " +
+                    std::to_string(reactor_count));
+        reactor_count = inherited_listeners.size();
+    }
+    connections.set_owner_count(reactor_count);
+    if (busy_poll_spin.count() > 0 && reactor_count >= static_cast<std::size_t>(hardware_threads)) {
+        logger.warn("Busy polling " + std::to_string(reactor_count) + " reactors on " +
+                    std::to_string(hardware_threads) + " CPUs, the pool workers will wait for cores");
+    }
+    logger.info("Listener options: " + socket_options.to_string());
+
+    for (std::size_t i = 0; i < reactor_count; ++i) {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->id = static_cast<int>(i);
+        reactor->epoll_fd = epoll_create1(0);
+        if (reactor->epoll_fd == -1) {
+            logger.error(Error(std::string("Failed to create epoll instance")));
+            return;
+        }
+        if (reactor->mailbox.open().log_error().is_err()) {
+            return;
+        }
+        if (reactor_count > 1 || busy_poll_spin.count() > 0) {
+            reactor->cpu = (cpu_offset + reactor->id) % hardware_threads;
+        }
+        if (!inherited_listeners.empty()) {
+            // drop the socket the default constructor opened
+            reactor->server_socket.close().log_error("Failed to close placeholder socket");
+            auto listener = TcpSocket::from_listening_fd(inherited_listeners[i]);
+            if (listener.log_error("Failed to adopt inherited listener").is_err()) {
+                return;
+            }
+            reactor->server_socket = listener.unwrap();
+            reactor->server_socket.apply_options(socket_options);
+            logger.info(
+                "Serving inherited listener " + reactor->server_socket.socket_info() +
+                " (reactor " + std::to_string(reactor->id) + ")"
+            );
+            reactors.push_back(std::move(reactor));
+            continue;
+        }
+        if (is_unix_address(address)) {
+            reactor->server_socket.close().log_error("Failed to close placeholder socket");
+            // SO_REUSEPORT does not spread AF_UNIX connections, so the
+            // reactors share one listener and wake one at a time on it
+            auto listener = reactors.empty()
+                ? TcpSocket::listen_unix(address.substr(std::strlen(UNIX_ADDRESS_PREFIX)), listen_backlog, socket_options)
+                : TcpSocket::from_listening_fd(fcntl(reactors.front()->server_socket.get_fd(), F_DUPFD_CLOEXEC, 0));
+            if (listener.log_error("Failed to open unix listener").is_err()) {
+                return;
+            }
+            reactor->server_socket = listener.unwrap();
+            logger.info(
+                "Listening for incoming connections on " + reactor->server_socket.socket_info() +
+                " (reactor " + std::to_string(reactor->id) + ")..."
+            );
+            reactors.push_back(std::move(reactor));
+            continue;
+        }
+        if (reactor_count > 1) {
+            reactor->server_socket.set_reuse_port()
+                .log_error("Failed to enable SO_REUSEPORT");
+        }
+        // buffer sizes must be in place before listen to set the window scale
+        reactor->server_socket.apply_options(socket_options);
+        reactor->server_socket.listen(address, port, listen_backlog)
+            .finally<void*>([&]() {
+                logger.info(
+                    "Listening for incoming connections (reactor " +
+                    std::to_string(reactor->id) + ")..."
+                );
+                return nullptr;
+            });
+        reactors.push_back(std::move(reactor));
+    }
+}
+
+bool TcpServer::is_unix_address(const std::string& address) {
+    return address.rfind(UNIX_ADDRESS_PREFIX, 0) == 0;
+}
+
+std::string TcpServer::describe_address(int port, const std::string& address) {
+    return is_unix_address(address) ? address : address + ":" + std::to_string(port);
 }
 
 void TcpServer::stop() {
-    if (!server_thread.joinable()) {
+    if (!running.exchange(false)) {
         return;
     }
-    
-    Logger::instance().info(
-        "Stopping TCP server on " + 
-        (server_socket.get_host().value_or("unknown") + 
-        ":" + 
-        std::to_string(server_socket.get_port().value_or(0)))
-    );
-    server_socket.hard_close();
-    
-    if (server_thread.joinable()) {
-        server_thread.join();
+
+    for (auto& reactor : reactors) {
+        Logger::instance().info(
+            "Stopping TCP server on " + reactor->server_socket.socket_info() +
+            " (reactor " + std::to_string(reactor->id) + ")"
+        );
+        // closed rather than shut down: after a handoff the listening socket
+        // is shared with the new process and must keep listening there
+        reactor->server_socket.close();
+        // an empty task only wakes the loop so it sees running is false
+        reactor->mailbox.post([]() {});
+    }
+
+    for (auto& reactor : reactors) {
+        if (reactor->thread.joinable()) {
+            reactor->thread.join();
+        }
     }
 }
 
 void TcpServer::run() {
-    if (server_thread.joinable()) {
+    if (running.exchange(true)) {
         Logger::instance().info("Server is already running");
         return;
     }
-    
-    server_thread = std::thread(&TcpServer::run_loop, this);
+    if (tls && io_backend == IoBackend::IO_URING) {
+        logger.warn("TLS connections are served on epoll instead of io_uring");
+    }
+
+    for (auto& reactor : reactors) {
+        reactor->thread = std::thread(&TcpServer::run_loop, this, std::ref(*reactor));
+    }
 }
 
+void TcpServer::pin_to_cpu(const Reactor& reactor) {
+    if (!reactor.cpu.has_value()) return;
 
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(*reactor.cpu, &cpu_set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0) {
+        logger.warn("Failed to pin reactor " + std::to_string(reactor.id) +
+                    " to cpu " + std::to_string(*reactor.cpu));
+        return;
+    }
+    logger.debug("Pinned reactor " + std::to_string(reactor.id) +
+                 " to cpu " + std::to_string(*reactor.cpu));
+}
 
 
-void TcpServer::handle_server_event() {
-    auto accept_result = server_socket.accept();
-    if (accept_result.log_error("Failed to accept connection").is_err()) return;
+TcpServer::Reactor& TcpServer::reactor_of(const TcpSocket& client_socket) {
+    return *reactors.at(client_socket.get_reactor_id());
+}
+
+
+// A reconnect storm fills the backlog faster than one accept per wakeup
+// could empty it.
+void TcpServer::handle_server_event(Reactor& reactor) {
+    for (int accepted = 0; accepted < MAX_ACCEPTS_PER_WAKEUP; ++accepted) {
+        auto accept_result = reactor.server_socket.accept();
+        if (accept_result.is_err()) {
+            int error = accept_result.unwrap_err().get_errno();
+            if (error == EAGAIN || error == EWOULDBLOCK) return;
+            // the peer gave up while queued
+            if (error == ECONNABORTED || error == EINTR) continue;
+            accept_result.log_error("Failed to accept connection");
+            return;
+        }
+        accept_connection(reactor, accept_result.unwrap());
+    }
+}
 
-    TcpSocket client_socket = accept_result.unwrap();
+void TcpServer::accept_connection(Reactor& reactor, TcpSocket client_socket) {
+    if (tls && client_socket.start_tls(tls->get()).log_error("Failed to start TLS").is_err()) {
+        client_socket.close();
+        return;
+    }
+    if (zerocopy_threshold > 0 && !reactor.ring && !client_socket.is_tls() && !client_socket.is_unix_domain()) {
+        client_socket.enable_zerocopy(zerocopy_threshold).log_debug();
+    }
+    if (!admission) {
+        add_connection(reactor, std::move(client_socket));
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto slot = admission->reserve(now);
+    bool waits = slot.has_value() && *slot > now;
+    if (waits) {
+        // input stays in the kernel until the slot comes up
+        client_socket.set_flag(TcpSocket::AWAITING_ADMISSION);
+        client_socket.set_read_paused(true);
+    }
+    ConnectionHandle handle = add_connection(reactor, std::move(client_socket));
+    TcpSocket* added = connections.find(handle);
+    if (added == nullptr) return;
+
+    if (!slot.has_value()) {
+        admissions_refused.fetch_add(1, std::memory_order_relaxed);
+        auto retry_after = admission->retry_after(now, retry_jitter);
+        logger.debug("Admission queue full, " + added->socket_info() +
+                     " retries after " + std::to_string(retry_after.count()) + "s");
+        reject_input(reactor, *added, retry_later_response(retry_after));
+    } else if (waits) {
+        admissions_delayed.fetch_add(1, std::memory_order_relaxed);
+        arm_idle_timer(reactor, *added, *slot);
+    }
+}
+
+// Runs from the idle timer armed for the connection's slot.
+void TcpServer::admit_connection(Reactor& reactor, TcpSocket& client_socket) {
+    client_socket.set_flag(TcpSocket::AWAITING_ADMISSION, false);
+    client_socket.set_read_paused(false);
+    arm_idle_timer(reactor, client_socket, std::chrono::steady_clock::now() + client_timeout);
+    if (reactor.ring) {
+        arm_uring_recv(reactor, client_socket.get_fd());
+    } else {
+        // edge triggered, what arrived while waiting raised no event
+        read_until_eagain(client_socket);
+    }
+}
+
+void TcpServer::run_on_reactors(const std::function<void(Reactor&)>& task) {
+    if (!running) {
+        for (auto& reactor : reactors) task(*reactor);
+        return;
+    }
+
+    std::vector<std::future<void>> done;
+    for (auto& reactor : reactors) {
+        auto promise = std::make_shared<std::promise<void>>();
+        done.push_back(promise->get_future());
+        Reactor* target = reactor.get();
+        target->mailbox.post([target, task, promise]() {
+            task(*target);
+            promise->set_value();
+        });
+    }
+    for (auto& future : done) future.wait();
+}
+
+ConnectionHandle TcpServer::add_connection(Reactor& reactor, TcpSocket client_socket) {
+    client_socket.set_reactor_id(reactor.id);
 
     logger.debug("Accepted connection from " + client_socket.socket_info());
     on_client_connected(client_socket);
 
     int client_fd = client_socket.get_fd();
-    connections.emplace(client_fd, std::move(client_socket));
+    ConnectionHandle handle = connections.insert(reactor.id, std::move(client_socket));
+    if (!handle.is_valid()) {
+        close(client_fd);
+        return handle;
+    }
+    TcpSocket& added = *connections.find(handle);
+    arm_idle_timer(reactor, added, std::chrono::steady_clock::now() + client_timeout);
+
+    if (reactor.ring) {
+        if (!added.is_read_paused()) arm_uring_recv(reactor, client_fd);
+        return handle;
+    }
 
     struct epoll_event client_ev;
     client_ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
-    client_ev.data.fd = client_fd;
+    client_ev.data.u64 = handle.pack();
     
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_ev) == -1) {
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, client_fd, &client_ev) == -1) {
         logger.error(Error("Failed to add client socket to epoll"));
-        connections.erase(client_fd);
-        return;
+        connections.remove(handle);
+        close(client_fd);
+        return ConnectionHandle{};
     }
-    
+    return handle;
 }
 
 
-void TcpServer::handle_client_event(int fd,uint32_t events) {
+void TcpServer::handle_client_event(Reactor& reactor, ConnectionHandle handle, uint32_t events) {
 
-    auto it = connections.find(fd);
-    if (it == connections.end()) {
-        logger.warn("Received event for unknown socket fd: " + std::to_string(fd));
+    TcpSocket* found = connections.find(handle);
+    if (found == nullptr) {
+        // queued for a connection that was closed earlier in the same batch
+        logger.debug("Dropping event for closed connection fd: " + std::to_string(handle.fd));
         return;
     }
-    TcpSocket& client_socket = it->second;
+    TcpSocket& client_socket = *found;
+
+    if (reactor.closing.count(handle.fd)) {
+        return;
+    }
+
+    // finished zerocopy sends are reported as errors too
+    if ((events & EPOLLERR) && (client_socket.is_zerocopy_enabled() || client_socket.has_zerocopy_in_flight())) {
+        if (!reap_zerocopy(client_socket)) {
+            handle_error(client_socket);
+            return;
+        }
+        events &= ~EPOLLERR;
+    }
 
     if (events & (EPOLLHUP | EPOLLERR)) {
         handle_error(client_socket);
@@ -108,21 +331,187 @@ void TcpServer::handle_client_event(int fd,uint32_t events) {
         return;
     }
     
-    if (events & EPOLLIN) {
+    if ((events & EPOLLIN) && !client_socket.is_read_paused()) {
         read_until_eagain(client_socket);
+        // input over a limit or a failed read may have closed it
+        if (connections.find(handle) == nullptr || reactor.closing.count(handle.fd)) return;
     }
     
+    if ((events & EPOLLOUT) && client_socket.tls_handshake_wants_write() && !client_socket.is_read_paused()) {
+        read_until_eagain(client_socket);
+        if (connections.find(handle) == nullptr || reactor.closing.count(handle.fd)) return;
+    }
+
     if (events & EPOLLOUT) {
         write_until_eagain(client_socket);
     }
 }
 
-void TcpServer::handle_socket_close(TcpSocket& client_socket) {
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket.get_fd(), nullptr);
-    connections.erase(client_socket.get_fd());
+void TcpServer::handle_socket_close(TcpSocket& client_socket, bool hard) {
+    Reactor& reactor = reactor_of(client_socket);
+    int fd = client_socket.get_fd();
+    if (reactor.ring) {
+        release_uring_ops(reactor, fd);
+    } else {
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    ConnectionHandle handle = client_socket.get_handle();
+    std::size_t dropped = thread_pool.dequeue(handle);
+    auto in_flight = reactor.jobs_in_flight.find(fd);
+    if (in_flight != reactor.jobs_in_flight.end()) {
+        in_flight->second -= dropped;
+        if (in_flight->second > 0) {
+            logger.debug("Deferring close of " + client_socket.socket_info() + " until its jobs complete");
+            client_socket.shutdown_read_write().log_debug();
+            reactor.closing.insert(fd);
+            return;
+        }
+        reactor.jobs_in_flight.erase(in_flight);
+    }
+
+    retire_zerocopy(reactor, client_socket);
+    // the slot is freed first, the fd could be reused as soon as it is closed
+    auto closed = connections.remove(handle);
+    if (!closed.has_value()) return;
+    if (hard) {
+        closed->hard_close().log_error("Failed to hard close socket");
+    } else {
+        closed->close().log_error("Failed to close socket");
+    }
+}
+
+void TcpServer::finish_deferred_close(Reactor& reactor, ConnectionHandle handle) {
+    reactor.closing.erase(handle.fd);
+    TcpSocket* found = connections.find(handle);
+    if (found != nullptr) retire_zerocopy(reactor, *found);
+    auto closed = connections.remove(handle);
+    if (!closed.has_value()) return;
+    closed->close().log_error("Failed to close socket");
+}
+
+bool TcpServer::reap_zerocopy(TcpSocket& client_socket) {
+    auto reaped = client_socket.reap_zerocopy();
+    if (reaped.log_debug().is_err()) return false;
+    ZerocopyCompletions completions = reaped.unwrap();
+    zerocopy_completed.fetch_add(completions.sends, std::memory_order_relaxed);
+    zerocopy_copied.fetch_add(completions.copied, std::memory_order_relaxed);
+    if (completions.copied > 0) {
+        logger.debug("Kernel copied zerocopy sends to " + client_socket.socket_info() + ", sending plainly");
+    }
+    return true;
+}
 
+void TcpServer::retire_zerocopy(Reactor& reactor, TcpSocket& client_socket) {
+    if (!client_socket.has_zerocopy_in_flight()) return;
+    // the notifications that are in already need no waiting for
+    client_socket.reap_zerocopy().log_debug();
+    auto buffers = client_socket.take_zerocopy_in_flight();
+    if (buffers.empty()) return;
+    reactor.zerocopy_retired.push_back(RetiredBuffers{
+        std::chrono::steady_clock::now() + std::chrono::seconds(ZEROCOPY_RETIRE_SECONDS),
+        std::move(buffers),
+    });
+}
+
+void TcpServer::release_retired_zerocopy(Reactor& reactor, std::chrono::steady_clock::time_point now) {
+    while (!reactor.zerocopy_retired.empty() && reactor.zerocopy_retired.front().until <= now) {
+        reactor.zerocopy_retired.pop_front();
+    }
 }
 
+// Runs on a pool worker. The socket keeps its slot until the completion
+// below has been processed, see handle_socket_close.
+void TcpServer::handle_job(ConnectionHandle handle, std::string message) {
+    TcpSocket* client_socket = connections.find(handle);
+    if (client_socket == nullptr) {
+        logger.error("Dropping job of closed connection fd: " + std::to_string(handle.fd));
+        return;
+    }
+    Reactor& reactor = reactor_of(*client_socket);
+    // Result is move-only and tasks must be copyable
+    std::shared_ptr<Result<std::string>> response;
+    try {
+        response = std::make_shared<Result<std::string>>(
+            handle_message(*client_socket, std::move(message))
+        );
+    } catch (const std::exception& e) {
+        // the reactor still has to hear back, or the connection never closes
+        response = std::make_shared<Result<std::string>>(
+            Error("Handler threw: " + std::string(e.what())));
+    }
+    // jobs of one socket run one at a time, so the flag is this job's
+    bool last = client_socket->has_flag(TcpSocket::CLOSE_AFTER_RESPONSE);
+    if (last) client_socket->set_flag(TcpSocket::CLOSE_AFTER_RESPONSE, false);
+    reactor.mailbox.post([this, &reactor, handle, response, last]() {
+        complete_job(reactor, handle, *response, last);
+    });
+}
+
+void TcpServer::complete_job(Reactor& reactor, ConnectionHandle handle, Result<std::string>& response, bool last) {
+    int fd = handle.fd;
+    auto in_flight = reactor.jobs_in_flight.find(fd);
+    if (in_flight != reactor.jobs_in_flight.end() && --in_flight->second == 0) {
+        reactor.jobs_in_flight.erase(in_flight);
+    }
+    if (reactor.closing.count(fd)) {
+        if (!reactor.jobs_in_flight.count(fd)) {
+            finish_deferred_close(reactor, handle);
+        }
+        return;
+    }
+    TcpSocket* found = connections.find(handle);
+    if (found == nullptr) return;
+    TcpSocket& client_socket = *found;
+
+    if(response.log_error("Failed to handle message").is_err()) {
+        handle_error(client_socket);
+        return;
+    }
+    // nothing but the rejection is answered once input broke a limit
+    if(client_socket.has_flag(TcpSocket::REJECTED)) return;
+    if(last) {
+        // requests pipelined behind it go unanswered, like input after a
+        // rejection, and the connection closes the same way
+        reject_input(reactor, client_socket, response.unwrap());
+        return;
+    }
+    client_socket.append_send_buffer(response.unwrap());
+    if(client_socket.is_half_closed()) {
+        auto read_result = client_socket.shutdown_read();
+        if(read_result.log_error("Failed to shutdown read while half closed").is_err()) {
+            handle_error(client_socket);
+            return;
+        }
+    } else if(!client_socket.peek_unread().empty()) {
+        // input that came with the message may belong to the protocol it switched to
+        dispatch_messages(client_socket);
+    }
+    schedule_flush(client_socket);
+}
+
+void TcpServer::schedule_flush(TcpSocket& client_socket) {
+    reactor_of(client_socket).pending_flush.push_back(client_socket.get_handle());
+}
+
+void TcpServer::drain_mailbox(Reactor& reactor) {
+    reactor.mailbox.drain();
+}
+
+// Runs once per loop iteration, after the whole batch of events.
+void TcpServer::flush_pending(Reactor& reactor) {
+    if (reactor.pending_flush.empty()) return;
+    std::vector<ConnectionHandle> flush;
+    flush.swap(reactor.pending_flush);
+    std::sort(flush.begin(), flush.end());
+    flush.erase(std::unique(flush.begin(), flush.end()), flush.end());
+    for (ConnectionHandle handle : flush) {
+        // a task later in the batch may have closed the socket
+        TcpSocket* client_socket = connections.find(handle);
+        if (client_socket == nullptr || reactor.closing.count(handle.fd)) continue;
+        write_until_eagain(*client_socket);
+    }
+}
 void TcpServer::drain_and_close(TcpSocket& client_socket) {
     logger.debug("Draining and closing client " + client_socket.socket_info());
     auto shutdown_result = client_socket.shutdown_read();
@@ -138,112 +527,668 @@ void TcpServer::drain_and_close(TcpSocket& client_socket) {
     if(drain_result.unwrap()) {
         logger.debug("Drained client " + client_socket.socket_info());
         handle_socket_close(client_socket);
-        client_socket.close().log_error("Failed to close socket");
     }
 }
 
 void TcpServer::read_until_eagain(TcpSocket& client_socket) {
     logger.debug("Reading data from client " + client_socket.socket_info());
 
-    auto receive_result = client_socket.receive();
-
-    
-    if(receive_result.log_error("Failed to read data").is_err()) {
-        handle_error(client_socket);
+    if (client_socket.has_flag(TcpSocket::REJECTED)) {
+        auto drain_result = client_socket.drain();
+        if (drain_result.log_error("Failed to drain rejected client").is_err()) {
+            handle_error(client_socket);
+        } else if (drain_result.unwrap()) {
+            handle_socket_close(client_socket);
+        }
         return;
     }
-    if(receive_result.unwrap()) {
-        logger.debug("Received EOF from client " + client_socket.socket_info());
-        client_socket.shutdown_read().log_error("Failed to shutdown read");
-    }
-    auto messages = client_socket.flush_messages();
-    for (auto& message : messages) {
-        auto handle_message_result = handle_message(client_socket, message);
-        if(handle_message_result.log_error("Failed to handle message").is_err()) {
+
+    // reads stop at max_unread so a client cannot buffer more than one
+    // message over the limits; the limits are checked before reading on
+    ConnectionHandle handle = client_socket.get_handle();
+    std::size_t max_unread = max_unread_bytes();
+    while (true) {
+        auto receive_result = client_socket.receive(max_unread);
+        if(receive_result.log_error("Failed to read data").is_err()) {
             handle_error(client_socket);
             return;
         }
-        auto response = handle_message_result.unwrap();
-        client_socket.set_send_buffer(response);
-        if(client_socket.is_half_closed()) {
-            auto read_result = client_socket.shutdown_read();
-            if(read_result.log_error("Failed to shutdown read while half closed").is_err()) {
-                handle_error(client_socket);
+        if(receive_result.unwrap()) {
+            logger.debug("Received EOF from client " + client_socket.socket_info());
+            client_socket.shutdown_read().log_error("Failed to shutdown read");
+        }
+        bool at_limit = client_socket.peek_unread().size() >= max_unread;
+        dispatch_messages(client_socket);
+
+        if (!at_limit || receive_result.unwrap()) return;
+        TcpSocket* found = connections.find(handle);
+        if (found == nullptr || found->has_flag(TcpSocket::REJECTED) ||
+            found->peek_unread().size() >= max_unread) {
+            return;
+        }
+    }
+}
+
+void TcpServer::dispatch_messages(TcpSocket& client_socket) {
+    if (client_socket.has_flag(TcpSocket::REJECTED)) {
+        client_socket.drain_buffer();
+        return;
+    }
+    Reactor& reactor = reactor_of(client_socket);
+    auto messages = client_socket.flush_messages();
+
+    std::optional<std::string> rejection;
+    for (const auto& message : messages) {
+        rejection = check_limits(client_socket, message);
+        if (rejection.has_value()) break;
+    }
+    if (!rejection.has_value()) {
+        rejection = check_limits(client_socket, client_socket.peek_unread());
+    }
+    if (rejection.has_value()) {
+        reject_input(reactor, client_socket, std::move(*rejection));
+        return;
+    }
+
+    // the data rate of an incomplete message is measured from its first
+    // bytes, see close_idle_connections
+    auto now = std::chrono::steady_clock::now();
+    if (client_socket.peek_unread().empty()) {
+        client_socket.set_partial_since({});
+    } else if (!messages.empty() || client_socket.get_partial_since() == std::chrono::steady_clock::time_point{}) {
+        client_socket.set_partial_since(now);
+        auto check = now + limits.data_rate_grace;
+        if (check < client_socket.get_idle_deadline()) arm_idle_timer(reactor, client_socket, check);
+    }
+
+    if (messages.empty()) return;
+
+    // shed answers skip the pool, so only while none of the socket's
+    // messages are with it, which keeps responses in order
+    std::size_t first_job = 0;
+    if (is_overloaded() && !reactor.jobs_in_flight.count(client_socket.get_fd())) {
+        for (; first_job < messages.size(); ++first_job) {
+            auto answer = shed_message(client_socket, messages[first_job]);
+            if (!answer.has_value()) break;
+            shed_messages.fetch_add(1, std::memory_order_relaxed);
+            if (client_socket.has_flag(TcpSocket::CLOSE_AFTER_RESPONSE)) {
+                // the rest of the input goes unanswered
+                client_socket.set_flag(TcpSocket::CLOSE_AFTER_RESPONSE, false);
+                reject_input(reactor, client_socket, std::move(*answer));
                 return;
             }
+            client_socket.append_send_buffer(std::move(*answer));
+        }
+        if (first_job > 0) schedule_flush(client_socket);
+    }
+    if (first_job == messages.size()) return;
+
+    reactor.jobs_in_flight[client_socket.get_fd()] += messages.size() - first_job;
+    for (std::size_t i = first_job; i < messages.size(); ++i) {
+        Priority priority = message_priority(client_socket, messages[i]);
+        thread_pool.enqueue(client_socket.get_handle(), std::move(messages[i]), priority);
+    }
+}
+
+// The input is dropped and the rejection, or the last response, written.
+// The connection then
+// lingers: reads go on and are discarded until the client closes, so the
+// rejection is not destroyed by the reset that closing with unread input
+// sends. The idle timer bounds how long.
+void TcpServer::reject_input(Reactor& reactor, TcpSocket& client_socket, std::string response) {
+    client_socket.drain_buffer();
+    client_socket.set_partial_since({});
+    client_socket.set_flag(TcpSocket::REJECTED);
+    client_socket.append_send_buffer(std::move(response));
+    arm_idle_timer(reactor, client_socket, std::chrono::steady_clock::now() + limits.data_rate_grace);
+    schedule_flush(client_socket);
+}
+
+std::optional<std::string> TcpServer::check_limits(TcpSocket&, std::string_view) {
+    return std::nullopt;
+}
+
+std::string TcpServer::retry_later_response(std::chrono::seconds) {
+    return "";
+}
+
+std::optional<std::string> TcpServer::shed_message(TcpSocket&, std::string_view) {
+    return std::nullopt;
+}
+
+Priority TcpServer::message_priority(TcpSocket&, std::string_view) {
+    return Priority::NORMAL;
+}
+
+void TcpServer::record_loop_lag(Reactor& reactor, std::chrono::steady_clock::duration busy) {
+    auto sample = std::chrono::duration_cast<std::chrono::microseconds>(busy).count();
+    auto lag = reactor.loop_lag_us.load(std::memory_order_relaxed);
+    // moving average over roughly the last 8 batches
+    reactor.loop_lag_us.store(lag + (sample - lag) / 8, std::memory_order_relaxed);
+}
+
+bool TcpServer::is_overloaded() {
+    std::int64_t lag = 0;
+    for (auto& reactor : reactors) {
+        lag = std::max(lag, reactor->loop_lag_us.load(std::memory_order_relaxed));
+    }
+    std::size_t depth = thread_pool.get_stats().queue_depth;
+    std::int64_t max_lag = std::chrono::duration_cast<std::chrono::microseconds>(overload_policy.max_loop_lag).count();
+
+    bool was = overloaded.load(std::memory_order_relaxed);
+    bool is = was
+        ? lag * 2 >= max_lag || depth * 2 >= overload_policy.max_queue_depth
+        : lag > max_lag || depth > overload_policy.max_queue_depth;
+    if (is != was && overloaded.compare_exchange_strong(was, is)) {
+        std::string load = "loop lag " + std::to_string(lag / 1000) + "ms, queue depth " + std::to_string(depth);
+        if (is) {
+            overload_episodes.fetch_add(1, std::memory_order_relaxed);
+            logger.warn("Overloaded, shedding load: " + load);
+        } else {
+            logger.info("No longer overloaded: " + load);
         }
     }
+    return is;
+}
 
+void TcpServer::count_limit(Limit limit) {
+    limit_hits[static_cast<std::size_t>(limit)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::size_t TcpServer::max_unread_bytes() const {
+    // 14 is the largest WebSocket frame header
+    return std::max(limits.max_header_bytes + limits.max_body_bytes, limits.max_frame_bytes + 14);
+}
 
+bool TcpServer::is_too_slow(const TcpSocket& client_socket, std::chrono::steady_clock::time_point now) const {
+    auto since = client_socket.get_partial_since();
+    // a paused client is not read from, so its rate says nothing
+    if (since == std::chrono::steady_clock::time_point{} || client_socket.is_read_paused()) return false;
+    auto elapsed = now - since;
+    if (elapsed < limits.data_rate_grace) return false;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return client_socket.peek_unread().size() < limits.min_data_rate * seconds;
 }
 
 void TcpServer::write_until_eagain(TcpSocket& client_socket) {
     logger.debug("Writing data to client " + client_socket.socket_info());
 
+    Reactor& reactor = reactor_of(client_socket);
+    if (reactor.ring) {
+        submit_uring_send(reactor, client_socket);
+        apply_backpressure(reactor, client_socket);
+        return;
+    }
+
     auto send_result = client_socket.send();
     if (send_result.log_error("Failed to send data").is_err()) {
         handle_error(client_socket);
         return;
     }
-    if(send_result.unwrap()) {
-        client_socket.hard_close();
+    apply_backpressure(reactor, client_socket);
+}
+
+std::size_t TcpServer::queued_send_bytes(Reactor& reactor, const TcpSocket& client_socket) const {
+    std::size_t bytes = client_socket.pending_send_bytes();
+    auto chain = reactor.send_chains.find(client_socket.get_fd());
+    if (chain != reactor.send_chains.end()) bytes += chain->second->bytes;
+    return bytes;
+}
+
+// Stops reading from a client that does not read its responses, so its
+// requests cannot grow the output queue without bound. With edge-triggered
+// epoll nothing signals input that arrived while paused, hence the explicit
+// read on resume.
+void TcpServer::apply_backpressure(Reactor& reactor, TcpSocket& client_socket) {
+    std::size_t queued = queued_send_bytes(reactor, client_socket);
+    bool rejected = client_socket.has_flag(TcpSocket::REJECTED);
+    if (rejected && queued == 0) {
+        client_socket.shutdown_write().log_debug();
+    }
+    // reads are already paused, so this is output the client does not take,
+    // such as broadcasts to a stalled spectator
+    if (!rejected && queued > limits.max_output_bytes) {
+        count_limit(Limit::OUTPUT);
+        logger.warn("Dropping " + client_socket.socket_info() + ", " +
+                    std::to_string(queued) + " bytes of output unread");
+        handle_error(client_socket);
+        return;
+    }
+    if (!client_socket.is_read_paused()) {
+        // a rejected client is read on until it closes
+        if (rejected || queued < send_high_watermark) return;
+        logger.debug("Pausing reads from " + client_socket.socket_info() + ", " +
+                     std::to_string(queued) + " bytes queued");
+        client_socket.set_read_paused(true);
+        if (reactor.ring) pause_uring_recv(reactor, client_socket.get_fd());
+        return;
+    }
+
+    if (queued > send_low_watermark || reactor.detaching ||
+        client_socket.has_flag(TcpSocket::AWAITING_ADMISSION)) {
+        return;
+    }
+    logger.debug("Resuming reads from " + client_socket.socket_info());
+    client_socket.set_read_paused(false);
+    if (!reactor.ring) {
+        read_until_eagain(client_socket);
+    } else if (!reactor.recv_ops.count(client_socket.get_fd())) {
+        arm_uring_recv(reactor, client_socket.get_fd());
     }
 }
 
 void TcpServer::handle_error(TcpSocket& client_socket) {
-    handle_socket_close(client_socket);
-    client_socket.hard_close().log_error("Failed to hard close socket");
+    handle_socket_close(client_socket, true);
 }
 
 
-void TcpServer::close_idle_connections() {
-    for (auto& [fd, socket] : connections) {
-        if (socket.should_timeout(client_timeout)) {
-            logger.debug("Closing idle connection " + socket.socket_info());
-            auto shutdown_result = socket.shutdown_read();
-            if(shutdown_result.log_error("Failed to shutdown read").is_err()) {
-                handle_error(socket);
-                return;
+bool TcpServer::on_client_idle(TcpSocket&) {
+    return true;
+}
+
+void TcpServer::arm_idle_timer(Reactor& reactor, TcpSocket& client_socket, std::chrono::steady_clock::time_point deadline) {
+    if (client_timeout == std::chrono::seconds::max()) return;
+    client_socket.set_idle_deadline(deadline);
+    reactor.idle_timers.schedule(client_socket.get_handle(), deadline);
+}
+
+// Only the timers that are due are visited. A socket that saw traffic since
+// its timer was armed is re-armed from its last activity instead of closed.
+void TcpServer::close_idle_connections(Reactor& reactor) {
+    auto now = std::chrono::steady_clock::now();
+    release_retired_zerocopy(reactor, now);
+    for (const auto& timer : reactor.idle_timers.advance(now)) {
+        // timer of a closed socket
+        TcpSocket* found = connections.find(timer.handle);
+        if (found == nullptr) continue;
+        TcpSocket& socket = *found;
+        // already re-armed
+        if (socket.get_idle_deadline() != timer.deadline) continue;
+        if (reactor.closing.count(timer.handle.fd)) continue;
+        if (socket.has_flag(TcpSocket::AWAITING_ADMISSION)) {
+            admit_connection(reactor, socket);
+            continue;
+        }
+        if (socket.has_flag(TcpSocket::REJECTED)) {
+            logger.debug("Closing rejected connection " + socket.socket_info());
+            handle_error(socket);
+            continue;
+        }
+        socket.release_buffers();
+
+        if (is_too_slow(socket, now)) {
+            count_limit(Limit::DATA_RATE);
+            logger.warn("Dropping " + socket.socket_info() + ", incomplete message arriving below " +
+                        std::to_string(limits.min_data_rate) + " bytes/s");
+            handle_error(socket);
+            continue;
+        }
+
+        auto deadline = socket.get_last_activity() + client_timeout;
+        // an incomplete message is checked again for its data rate
+        if (socket.get_partial_since() != std::chrono::steady_clock::time_point{}) {
+            deadline = std::min(deadline, now + limits.data_rate_grace);
+        }
+        if (deadline > now) {
+            arm_idle_timer(reactor, socket, deadline);
+            continue;
+        }
+        if (!on_client_idle(socket)) {
+            // the hook may have failed a write and closed the socket
+            TcpSocket* kept = connections.find(timer.handle);
+            if (kept != nullptr && !reactor.closing.count(timer.handle.fd)) {
+                arm_idle_timer(reactor, *kept, now + client_timeout);
             }
+            continue;
+        }
+
+        logger.debug("Closing idle connection " + socket.socket_info());
+        auto shutdown_result = socket.shutdown_read();
+        if(shutdown_result.log_error("Failed to shutdown read").is_err()) {
+            handle_error(socket);
         }
     }
 }
 
+int TcpServer::next_wakeup_ms(Reactor& reactor) {
+    auto wait = reactor.idle_timers.time_until_next(std::chrono::steady_clock::now());
+    if (!wait.has_value()) return -1;
+    return static_cast<int>(std::min<long long>(wait->count() + 1, INT_MAX));
+}
 
-void TcpServer::run_loop() {
 
-    struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = server_socket.get_fd();
+void TcpServer::run_loop(Reactor& reactor) {
+    pin_to_cpu(reactor);
+
+    if (io_backend == IoBackend::IO_URING && !tls && setup_uring(reactor)) {
+        run_uring_loop(reactor);
+    } else {
+        run_epoll_loop(reactor);
+    }
+
+    close(reactor.epoll_fd);
+}
+
+void TcpServer::run_epoll_loop(Reactor& reactor) {
+    // listener and mailbox are tagged with generation 0, which no connection has
+    std::uint64_t listener_tag = ConnectionHandle{reactor.server_socket.get_fd(), 0}.pack();
+    std::uint64_t mailbox_tag = ConnectionHandle{reactor.mailbox.get_fd(), 0}.pack();
+
+    if (reactor.accepting && add_listener(reactor).log_error().is_err()) {
+        return;
+    }
+
+    struct epoll_event mailbox_ev;
+    mailbox_ev.events = EPOLLIN;
+    mailbox_ev.data.u64 = mailbox_tag;
 
     if(Result<int>::from_bsd(
-        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket.get_fd(), &ev),
-        "Failed to add server socket to epoll"
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.mailbox.get_fd(), &mailbox_ev),
+        "Failed to add mailbox eventfd to epoll"
     ).log_error().is_err()) {
-        close(epoll_fd);
         return;
     }
 
-    while (true) {
-        int nfds = epoll_wait(epoll_fd, events.data(), MAX_EVENTS, 1000); // 1s wakeup for idle check
+    while (running) {
+        auto waiting = std::chrono::steady_clock::now();
+        int nfds = wait_epoll(reactor);
         if (nfds == -1) {
             if (errno == EINTR) continue;
             logger.error(Error(std::string("Failed to wait for events")));
             continue;
         }
+        auto ready = std::chrono::steady_clock::now();
+        // a loop that had time to sit idle is keeping up
+        if (ready - waiting >= overload_policy.max_loop_lag) reactor.loop_lag_us.store(0, std::memory_order_relaxed);
 
         for (int i = 0; i < nfds; i++) {
-            int fd = events[i].data.fd;
-            uint32_t ev = events[i].events;
+            std::uint64_t tag = reactor.events[i].data.u64;
+            uint32_t ev = reactor.events[i].events;
       
-            if (fd == server_socket.get_fd()) handle_server_event();
-            else handle_client_event(fd,ev);    
+            if (tag == listener_tag) handle_server_event(reactor);
+            else if (tag == mailbox_tag) drain_mailbox(reactor);
+            else handle_client_event(reactor, ConnectionHandle::unpack(tag), ev);
+        }
+
+        flush_pending(reactor);
+        close_idle_connections(reactor);
+        record_loop_lag(reactor, std::chrono::steady_clock::now() - ready);
+    }
+}
+
+// How long to poll before blocking: the spin budget, cut short by a timer
+// that is due sooner.
+static std::chrono::microseconds spin_budget(std::chrono::microseconds spin, int wakeup_ms) {
+    if (wakeup_ms < 0) return spin;
+    return std::min(spin, std::chrono::microseconds(wakeup_ms * 1000LL));
+}
+
+int TcpServer::wait_epoll(Reactor& reactor) {
+    if (busy_poll_spin.count() > 0) {
+        auto until = std::chrono::steady_clock::now() + spin_budget(busy_poll_spin, next_wakeup_ms(reactor));
+        do {
+            int nfds = epoll_wait(reactor.epoll_fd, reactor.events.data(), MAX_EVENTS, 0);
+            if (nfds != 0) return nfds;
+            // the pool worker answering the last request may share the core
+            sched_yield();
+        } while (running && std::chrono::steady_clock::now() < until);
+    }
+    return epoll_wait(reactor.epoll_fd, reactor.events.data(), MAX_EVENTS, next_wakeup_ms(reactor));
+}
+
+// io_uring backend. The listener, the mailbox eventfd and every socket get one
+// multishot operation each, so steady-state receives cost no syscalls besides
+// the single io_uring_enter per loop iteration that also carries all sends.
+
+bool TcpServer::setup_uring(Reactor& reactor) {
+    // created on the loop thread, the ring is set up for a single issuer
+    auto ring = std::make_unique<IoUring>();
+    auto setup_result = ring->setup(IO_URING_ENTRIES)
+        .chain<int>([&](int) {
+            return ring->setup_buffers(IO_URING_BUFFER_COUNT, IO_URING_BUFFER_SIZE);
+        });
+    if (setup_result.is_err()) {
+        logger.warn("io_uring unavailable for reactor " + std::to_string(reactor.id) +
+                    ", falling back to epoll: " + setup_result.unwrap_err().get_message());
+        return false;
+    }
+    reactor.ring = std::move(ring);
+    logger.debug("Reactor " + std::to_string(reactor.id) + " runs on io_uring");
+    return true;
+}
+
+void TcpServer::run_uring_loop(Reactor& reactor) {
+    if (reactor.accepting) {
+        reactor.ring->prepare_multishot_accept(reactor.server_socket.get_fd(), URING_ACCEPT_OP);
+    }
+    reactor.ring->prepare_multishot_poll(reactor.mailbox.get_fd(), URING_WAKEUP_OP);
+
+    while (running) {
+        auto waiting = std::chrono::steady_clock::now();
+        if (wait_uring(reactor).log_error().is_err()) continue;
+        auto ready = std::chrono::steady_clock::now();
+        if (ready - waiting >= overload_policy.max_loop_lag) reactor.loop_lag_us.store(0, std::memory_order_relaxed);
+
+        reactor.ring->for_each_completion([&](const IoUring::Completion& completion) {
+            handle_uring_completion(reactor, completion);
+        });
+
+        flush_pending(reactor);
+        close_idle_connections(reactor);
+        record_loop_lag(reactor, std::chrono::steady_clock::now() - ready);
+    }
+
+    // tearing the ring down cancels whatever is still in flight; buffers of
+    // unfinished sends stay alive in uring_ops until the reactor goes away
+    reactor.ring.reset();
+}
+
+Result<int> TcpServer::wait_uring(Reactor& reactor) {
+    if (busy_poll_spin.count() > 0) {
+        auto until = std::chrono::steady_clock::now() + spin_budget(busy_poll_spin, next_wakeup_ms(reactor));
+        do {
+            auto polled = reactor.ring->submit_and_wait(std::chrono::milliseconds(0));
+            if (polled.is_err() || reactor.ring->has_completions()) return polled;
+            sched_yield();
+        } while (running && std::chrono::steady_clock::now() < until);
+    }
+    int wait_ms = next_wakeup_ms(reactor);
+    std::optional<std::chrono::milliseconds> timeout;
+    if (wait_ms >= 0) timeout = std::chrono::milliseconds(wait_ms);
+    return reactor.ring->submit_and_wait(timeout);
+}
+
+void TcpServer::handle_uring_completion(Reactor& reactor, const IoUring::Completion& completion) {
+    if (completion.user_data == URING_ACCEPT_OP) {
+        handle_uring_accept(reactor, completion);
+        return;
+    }
+    if (completion.user_data == URING_WAKEUP_OP) {
+        drain_mailbox(reactor);
+        if (!(completion.flags & IORING_CQE_F_MORE) && running) {
+            reactor.ring->prepare_multishot_poll(reactor.mailbox.get_fd(), URING_WAKEUP_OP);
         }
+        return;
+    }
 
-        close_idle_connections();
+    auto it = reactor.uring_ops.find(completion.user_data);
+    if (it == reactor.uring_ops.end()) {
+        // late completion of a cancelled recv, only its buffer is of interest
+        auto buffer = IoUring::buffer_id(completion.flags);
+        if (buffer.has_value()) reactor.ring->recycle_buffer(*buffer);
+        return;
+    }
+
+    if (it->second.chain) {
+        UringOp op = std::move(it->second);
+        reactor.uring_ops.erase(it);
+        handle_uring_send(reactor, completion, std::move(op));
+        return;
     }
+    handle_uring_receive(reactor, completion, it->second.fd);
+}
 
-    close(epoll_fd);
+void TcpServer::handle_uring_accept(Reactor& reactor, const IoUring::Completion& completion) {
+    if (!running) {
+        if (completion.result >= 0) close(completion.result);
+        return;
+    }
+    if (!(completion.flags & IORING_CQE_F_MORE) && reactor.accepting) {
+        reactor.ring->prepare_multishot_accept(reactor.server_socket.get_fd(), URING_ACCEPT_OP);
+    }
+    if (completion.result == -ECANCELED && !reactor.accepting) return;
+    if (completion.result < 0) {
+        errno = -completion.result;
+        logger.error(Error("Failed to accept connection"));
+        return;
+    }
+
+    auto socket_result = TcpSocket::from_accepted_fd(completion.result);
+    if (socket_result.log_error("Failed to accept connection").is_err()) {
+        close(completion.result);
+        return;
+    }
+    accept_connection(reactor, socket_result.unwrap());
+}
+
+void TcpServer::arm_uring_recv(Reactor& reactor, int fd) {
+    std::uint64_t user_data = reactor.next_user_data++;
+    reactor.uring_ops.emplace(user_data, UringOp{fd, nullptr});
+    reactor.recv_ops[fd] = user_data;
+    reactor.ring->prepare_multishot_recv(fd, user_data);
+}
+
+void TcpServer::pause_uring_recv(Reactor& reactor, int fd) {
+    auto recv = reactor.recv_ops.find(fd);
+    if (recv == reactor.recv_ops.end()) return;
+    // the op stays registered until its final completion, so data that
+    // races with the cancel is still delivered and reads resume from there
+    reactor.ring->prepare_cancel(recv->second);
+}
+
+void TcpServer::handle_uring_receive(Reactor& reactor, const IoUring::Completion& completion, int fd) {
+    bool more = completion.flags & IORING_CQE_F_MORE;
+    if (!more) {
+        reactor.uring_ops.erase(completion.user_data);
+        reactor.recv_ops.erase(fd);
+    }
+
+    auto buffer = IoUring::buffer_id(completion.flags);
+    // ops are released when their socket closes, so fd names the connection
+    TcpSocket* found = connections.find(fd);
+    if (found == nullptr || reactor.closing.count(fd)) {
+        if (buffer.has_value()) reactor.ring->recycle_buffer(*buffer);
+        return;
+    }
+    TcpSocket& client_socket = *found;
+
+    // cancelled by pause_uring_recv, or out of buffers because every
+    // provided buffer is queued in the completion ring
+    if (completion.result == -ECANCELED || completion.result == -ENOBUFS) {
+        if (!client_socket.is_read_paused()) arm_uring_recv(reactor, fd);
+        return;
+    }
+
+    const char* data = buffer.has_value() ? reactor.ring->buffer_data(*buffer) : nullptr;
+    auto receive_result = client_socket.complete_receive(completion.result, data);
+    if (buffer.has_value()) reactor.ring->recycle_buffer(*buffer);
+
+    if (receive_result.log_error("Failed to read data").is_err()) {
+        handle_error(client_socket);
+        return;
+    }
+    if (receive_result.unwrap()) {
+        logger.debug("Received EOF from client " + client_socket.socket_info());
+        drain_and_close(client_socket);
+        return;
+    }
+
+    dispatch_messages(client_socket);
+    if (!more && !client_socket.is_read_paused()) arm_uring_recv(reactor, fd);
+}
+
+// Every queued chunk becomes one or more IO_URING_SEND_CHUNK sized sends,
+// linked into one chain so they go out in order within a single submission.
+void TcpServer::submit_uring_send(Reactor& reactor, TcpSocket& client_socket) {
+    int fd = client_socket.get_fd();
+    if (reactor.send_chains.count(fd) || !client_socket.has_pending_send()) return;
+
+    auto chain = std::make_shared<SendChain>();
+    chain->chunks = client_socket.take_send_queue();
+    chain->unsent_chunk = chain->chunks.size();
+
+    std::vector<UringOp> sends;
+    for (std::size_t index = 0; index < chain->chunks.size(); ++index) {
+        const std::string& chunk = chain->chunks[index];
+        chain->bytes += chunk.size();
+        for (std::size_t offset = 0; offset < chunk.size(); offset += IO_URING_SEND_CHUNK) {
+            std::size_t length = std::min<std::size_t>(IO_URING_SEND_CHUNK, chunk.size() - offset);
+            sends.push_back(UringOp{fd, chain, index, offset, length});
+        }
+    }
+
+    chain->outstanding = sends.size();
+    for (std::size_t i = 0; i < sends.size(); ++i) {
+        const UringOp& send = sends[i];
+        std::uint64_t user_data = reactor.next_user_data++;
+        const char* data = chain->chunks[send.chunk].data() + send.offset;
+        reactor.ring->prepare_send(fd, data, send.length, user_data, i + 1 < sends.size());
+        reactor.uring_ops.emplace(user_data, send);
+    }
+    reactor.send_chains.emplace(fd, std::move(chain));
+}
+
+void TcpServer::handle_uring_send(Reactor& reactor, const IoUring::Completion& completion, UringOp op) {
+    SendChain& chain = *op.chain;
+    --chain.outstanding;
+    if (completion.result != static_cast<int>(op.length)) {
+        // a failed link cancels the rest of the chain with -ECANCELED
+        if (completion.result >= 0 || completion.result == -ECANCELED) {
+            std::size_t offset = op.offset + std::max(completion.result, 0);
+            if (op.chunk < chain.unsent_chunk ||
+                (op.chunk == chain.unsent_chunk && offset < chain.unsent_offset)) {
+                chain.unsent_chunk = op.chunk;
+                chain.unsent_offset = offset;
+            }
+        } else if (chain.error == 0) {
+            chain.error = -completion.result;
+        }
+    }
+    if (chain.outstanding > 0) return;
+
+    auto current = reactor.send_chains.find(op.fd);
+    // the socket was closed while the chain was in flight
+    if (current == reactor.send_chains.end() || current->second != op.chain) return;
+    reactor.send_chains.erase(current);
+
+    TcpSocket* found = connections.find(op.fd);
+    if (found == nullptr || reactor.closing.count(op.fd)) return;
+    TcpSocket& client_socket = *found;
+
+    if (chain.error != 0) {
+        errno = chain.error;
+        logger.error(Error("Failed to send data"));
+        handle_error(client_socket);
+        return;
+    }
+    // put the unsent tail back in front of whatever was queued meanwhile
+    for (std::size_t index = chain.chunks.size(); index-- > chain.unsent_chunk;) {
+        std::string& chunk = chain.chunks[index];
+        client_socket.requeue_send(index == chain.unsent_chunk ? chunk.substr(chain.unsent_offset) : std::move(chunk));
+    }
+    submit_uring_send(reactor, client_socket);
+    apply_backpressure(reactor, client_socket);
+}
+
+void TcpServer::release_uring_ops(Reactor& reactor, int fd) {
+    auto recv = reactor.recv_ops.find(fd);
+    if (recv != reactor.recv_ops.end()) {
+        reactor.ring->prepare_cancel(recv->second);
+        reactor.uring_ops.erase(recv->second);
+        reactor.recv_ops.erase(recv);
+    }
+    // in-flight sends keep their chain alive through uring_ops
+    reactor.send_chains.erase(fd);
 }
 
 void TcpServer::set_client_timeout(std::chrono::seconds timeout) {
@@ -252,4 +1197,338 @@ void TcpServer::set_client_timeout(std::chrono::seconds timeout) {
 
 std::chrono::milliseconds TcpServer::get_client_timeout() const {
     return std::chrono::duration_cast<std::chrono::milliseconds>(client_timeout);
-}
\ No newline at end of file
+}
+
+void TcpServer::set_reactor_count(std::size_t count, int cpu_offset) {
+    if (!reactors.empty()) {
+        logger.warn("Reactor count can only be changed before start()");
+        return;
+    }
+    reactor_count = std::max<std::size_t>(1, count);
+    this->cpu_offset = cpu_offset;
+}
+
+std::size_t TcpServer::get_reactor_count() const {
+    return reactor_count;
+}
+
+void TcpServer::set_io_backend(IoBackend backend) {
+    if (running) {
+        logger.warn("IO backend can only be changed before run()");
+        return;
+    }
+    io_backend = backend;
+}
+
+IoBackend TcpServer::get_io_backend() const {
+    return io_backend;
+}
+
+void TcpServer::set_send_watermarks(std::size_t low, std::size_t high) {
+    send_low_watermark = std::min(low, high);
+    send_high_watermark = high;
+}
+
+bool TcpServer::is_above_high_watermark(const TcpSocket& client_socket) {
+    return queued_send_bytes(reactor_of(client_socket), client_socket) >= send_high_watermark;
+}
+
+bool TcpServer::is_below_low_watermark(const TcpSocket& client_socket) {
+    return queued_send_bytes(reactor_of(client_socket), client_socket) <= send_low_watermark;
+}
+
+void TcpServer::set_listen_backlog(int backlog) {
+    listen_backlog = backlog;
+}
+
+void TcpServer::set_socket_options(const SocketOptions& options) {
+    socket_options = options;
+}
+
+void TcpServer::set_busy_poll(std::chrono::microseconds spin) {
+    busy_poll_spin = spin;
+}
+
+void TcpServer::set_zerocopy_threshold(std::size_t threshold) {
+    zerocopy_threshold = threshold;
+}
+
+TcpServer::ZerocopyStats TcpServer::get_zerocopy_stats() const {
+    ZerocopyStats stats;
+    stats.completed = zerocopy_completed.load(std::memory_order_relaxed);
+    stats.copied = zerocopy_copied.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TcpServer::set_tls(std::shared_ptr<TlsContext> context) {
+    tls = std::move(context);
+}
+
+void TcpServer::set_admission(double rate, std::size_t burst, std::size_t max_waiting, std::chrono::seconds retry_jitter) {
+    admission = std::make_unique<AdmissionQueue>(rate, burst, max_waiting);
+    this->retry_jitter = retry_jitter;
+}
+
+TcpServer::AdmissionStats TcpServer::get_admission_stats() const {
+    return AdmissionStats{
+        admissions_delayed.load(std::memory_order_relaxed),
+        admissions_refused.load(std::memory_order_relaxed),
+    };
+}
+
+void TcpServer::set_overload_policy(const OverloadPolicy& policy) {
+    overload_policy = policy;
+}
+
+const TcpServer::OverloadPolicy& TcpServer::get_overload_policy() const {
+    return overload_policy;
+}
+
+TcpServer::OverloadStats TcpServer::get_overload_stats() {
+    bool is_overloaded_now = is_overloaded();
+    std::int64_t lag = 0;
+    for (auto& reactor : reactors) {
+        lag = std::max(lag, reactor->loop_lag_us.load(std::memory_order_relaxed));
+    }
+    return OverloadStats{
+        is_overloaded_now,
+        std::chrono::microseconds(lag),
+        thread_pool.get_stats().queue_depth,
+        overload_episodes.load(std::memory_order_relaxed),
+        shed_messages.load(std::memory_order_relaxed),
+    };
+}
+
+void TcpServer::set_limits(const Limits& limits) {
+    this->limits = limits;
+}
+
+const TcpServer::Limits& TcpServer::get_limits() const {
+    return limits;
+}
+
+TcpServer::LimitStats TcpServer::get_limit_stats() const {
+    auto hits = [this](Limit limit) {
+        return limit_hits[static_cast<std::size_t>(limit)].load(std::memory_order_relaxed);
+    };
+    return LimitStats{
+        hits(Limit::HEADER),
+        hits(Limit::BODY),
+        hits(Limit::FRAME),
+        hits(Limit::OUTPUT),
+        hits(Limit::DATA_RATE),
+    };
+}
+
+ThreadPool::Stats TcpServer::get_pool_stats() const {
+    return thread_pool.get_stats();
+}
+
+std::array<ThreadPool::LaneStats, PRIORITY_COUNT> TcpServer::get_lane_stats() {
+    return thread_pool.get_lane_stats();
+}
+
+void TcpServer::post(int reactor_id, Mailbox::Task task) {
+    reactors.at(reactor_id)->mailbox.post(std::move(task));
+}
+
+void TcpServer::post_to_connections(std::function<void(TcpSocket&)> visit) {
+    for (auto& reactor : reactors) {
+        Reactor* target = reactor.get();
+        target->mailbox.post([this, target, visit]() {
+            connections.for_each(target->id, [&](TcpSocket& client_socket) {
+                if (target->closing.count(client_socket.get_fd())) return;
+                visit(client_socket);
+            });
+        });
+    }
+}
+
+void TcpServer::adopt_listeners(std::vector<int> fds) {
+    if (!reactors.empty()) {
+        logger.warn("Listeners can only be adopted before start()");
+        return;
+    }
+    inherited_listeners = std::move(fds);
+}
+
+std::vector<int> TcpServer::get_listener_fds() const {
+    std::vector<int> fds;
+    for (const auto& reactor : reactors) {
+        fds.push_back(reactor->server_socket.get_fd());
+    }
+    return fds;
+}
+
+void TcpServer::pause_accepting() {
+    run_on_reactors([this](Reactor& reactor) {
+        if (!reactor.accepting) return;
+        reactor.accepting = false;
+        if (reactor.ring) {
+            reactor.ring->prepare_cancel(URING_ACCEPT_OP);
+        } else {
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, reactor.server_socket.get_fd(), nullptr);
+        }
+    });
+}
+
+void TcpServer::resume_accepting() {
+    run_on_reactors([this](Reactor& reactor) {
+        if (reactor.accepting) return;
+        reactor.accepting = true;
+        if (reactor.ring) {
+            reactor.ring->prepare_multishot_accept(reactor.server_socket.get_fd(), URING_ACCEPT_OP);
+            return;
+        }
+        add_listener(reactor).log_error();
+    });
+}
+
+Result<int> TcpServer::add_listener(Reactor& reactor) {
+    struct epoll_event ev;
+    // reactors sharing a unix listener would otherwise all wake for each
+    // connection; it is only ever added and deleted, never modified
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.u64 = ConnectionHandle{reactor.server_socket.get_fd(), 0}.pack();
+    return Result<int>::from_bsd(
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.server_socket.get_fd(), &ev),
+        "Failed to add server socket to epoll"
+    );
+}
+
+std::vector<TcpServer::DetachedConnection> TcpServer::detach_connections(bool force, std::size_t& remaining) {
+    std::mutex mutex;
+    std::vector<DetachedConnection> detached;
+    remaining = 0;
+
+    run_on_reactors([&](Reactor& reactor) {
+        reactor.detaching = true;
+        std::vector<ConnectionHandle> settled;
+        std::size_t unsettled = 0;
+        connections.for_each(reactor.id, [&](TcpSocket& client_socket) {
+            int fd = client_socket.get_fd();
+            if (reactor.closing.count(fd)) return;
+            if (!client_socket.is_read_paused()) {
+                client_socket.set_read_paused(true);
+                if (reactor.ring) pause_uring_recv(reactor, fd);
+            }
+            // the successor could not match the kernel's notifications
+            // of zerocopy sends made here
+            if (client_socket.has_zerocopy_in_flight()) reap_zerocopy(client_socket);
+            // a running job still holds a reference to the socket
+            bool idle = !reactor.jobs_in_flight.count(fd) &&
+                (force || (!reactor.recv_ops.count(fd) && !reactor.send_chains.count(fd) &&
+                           !client_socket.has_zerocopy_in_flight()));
+            if (idle) {
+                settled.push_back(client_socket.get_handle());
+            } else {
+                ++unsettled;
+            }
+        });
+
+        std::vector<DetachedConnection> taken;
+        for (ConnectionHandle handle : settled) {
+            TcpSocket& client_socket = *connections.find(handle);
+            if (client_socket.is_tls()) {
+                // the session lives in this process; close_notify first
+                client_socket.shutdown_write().log_debug();
+                handle_socket_close(client_socket);
+                continue;
+            }
+            taken.push_back(detach_connection(reactor, handle));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining += unsettled;
+        for (auto& connection : taken) {
+            detached.push_back(std::move(connection));
+        }
+    });
+    return detached;
+}
+
+TcpServer::DetachedConnection TcpServer::detach_connection(Reactor& reactor, ConnectionHandle handle) {
+    int fd = handle.fd;
+    TcpSocket& client_socket = *connections.find(handle);
+    if (reactor.ring) {
+        if (reactor.send_chains.count(fd)) {
+            logger.warn("Detaching " + client_socket.socket_info() + " with a send still in flight");
+        }
+        release_uring_ops(reactor, fd);
+    } else {
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    DetachedConnection connection{
+        fd,
+        client_socket.get_phase(),
+        static_cast<std::uint8_t>(client_socket.get_flags() & TcpSocket::PROTOCOL_FLAGS),
+        client_socket.take_unread(),
+        "",
+    };
+    for (auto& chunk : client_socket.take_send_queue()) {
+        connection.unsent += chunk;
+    }
+    retire_zerocopy(reactor, client_socket);
+    logger.debug("Detached connection " + client_socket.socket_info());
+    // the fd stays open, it now belongs to whoever receives the connection
+    connections.remove(handle);
+    return connection;
+}
+
+void TcpServer::cancel_detach() {
+    run_on_reactors([this](Reactor& reactor) {
+        reactor.detaching = false;
+        // resuming reads may close connections, so not while iterating
+        for (ConnectionHandle handle : connections.handles(reactor.id)) {
+            TcpSocket* client_socket = connections.find(handle);
+            if (client_socket == nullptr || reactor.closing.count(handle.fd)) continue;
+            if (client_socket->is_read_paused()) apply_backpressure(reactor, *client_socket);
+        }
+    });
+}
+
+void TcpServer::adopt_connection(DetachedConnection connection) {
+    Reactor* reactor = reactors.at(connection.fd % reactors.size()).get();
+    reactor->mailbox.post([this, reactor, connection]() {
+        auto socket_result = TcpSocket::from_accepted_fd(connection.fd);
+        if (socket_result.log_error("Failed to adopt connection").is_err()) {
+            close(connection.fd);
+            return;
+        }
+        TcpSocket client_socket = socket_result.unwrap();
+        client_socket.set_phase(connection.phase);
+        client_socket.set_flags(connection.flags);
+        client_socket.restore_unread(connection.unread);
+        client_socket.append_send_buffer(connection.unsent);
+        logger.debug("Adopted connection " + client_socket.socket_info());
+
+        ConnectionHandle handle = add_connection(*reactor, std::move(client_socket));
+        TcpSocket* adopted = connections.find(handle);
+        if (adopted == nullptr) return;
+        dispatch_messages(*adopted);
+        schedule_flush(*adopted);
+    });
+}
+
+TcpServer::ConnectionStats TcpServer::get_connection_stats() {
+    std::mutex mutex;
+    ConnectionStats stats;
+    run_on_reactors([&](Reactor& reactor) {
+        std::size_t bytes = 0;
+        connections.for_each(reactor.id, [&](TcpSocket& client_socket) {
+            bytes += client_socket.memory_usage() + ConnectionTable::slot_overhead();
+        });
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.connections += connections.size(reactor.id);
+        stats.bytes += bytes;
+    });
+    return stats;
+}
+
+std::size_t TcpServer::count_connections() {
+    std::atomic<std::size_t> count{0};
+    run_on_reactors([&](Reactor& reactor) {
+        count += connections.size(reactor.id);
+    });
+    return count;
+}
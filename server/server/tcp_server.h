@@ -1,29 +1,267 @@
 #pragma once
 
+#include "server/server/admission_queue.h"
+#include "server/server/connection_table.h"
+#include "server/server/io_uring.h"
+#include "server/server/mailbox.h"
 #include "server/server/tcp_socket.h"
 #include "server/server/thread_pool.h"
+#include "server/server/timing_wheel.h"
+#include "server/server/tls_context.h"
 
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sys/epoll.h>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #define MAX_EVENTS 64
+// accepts per listener wakeup; the listener is level triggered, so the
+// rest of the backlog is picked up after the other sockets' events
+#define MAX_ACCEPTS_PER_WAKEUP 256
+// start() address of an AF_UNIX listener, followed by its path
+#define UNIX_ADDRESS_PREFIX "unix:"
+#define IO_URING_ENTRIES 4096
+#define IO_URING_BUFFER_COUNT 512
+#define IO_URING_BUFFER_SIZE 4096
+#define IO_URING_SEND_CHUNK 65536
+// how long the buffers of zerocopy sends outlive a socket closed before the
+// kernel reported them sent, far longer than it normally takes
+#define ZEROCOPY_RETIRE_SECONDS 10
+
+enum class IoBackend {
+  EPOLL,
+  IO_URING,
+};
 
 class TcpServer {
+  public:
+    // A connection taken off its reactor without being closed, with the
+    // bytes it had buffered in either direction.
+    struct DetachedConnection {
+        int fd;
+        ConnectionPhase phase;
+        // TcpSocket::PROTOCOL_FLAGS only
+        std::uint8_t flags;
+        std::string unread;
+        std::string unsent;
+    };
+
+    struct ConnectionStats {
+        std::size_t connections = 0;
+        // sockets, their buffers and their table slots
+        std::size_t bytes = 0;
+    };
+
+    // Per-connection limits. Which input counts as header, body or frame is
+    // up to the protocol, see check_limits.
+    struct Limits {
+        std::size_t max_header_bytes = 8 * 1024;
+        std::size_t max_body_bytes = 64 * 1024;
+        std::size_t max_frame_bytes = 64 * 1024;
+        // output a client leaves unread, beyond the point where its reads
+        // are paused, before it is dropped
+        std::size_t max_output_bytes = 8 * 1024 * 1024;
+        // an incomplete message must keep arriving at this many bytes per
+        // second, checked once it is data_rate_grace old
+        std::size_t min_data_rate = 128;
+        std::chrono::seconds data_rate_grace{10};
+    };
+
+    struct AdmissionStats {
+        std::uint64_t delayed = 0;
+        std::uint64_t refused = 0;
+    };
+
+    // When the server counts as overloaded. It enters that state once any
+    // reactor's loop lag or the pool's queue depth passes its threshold and
+    // leaves it once all are back below half of it.
+    struct OverloadPolicy {
+        std::chrono::milliseconds max_loop_lag{50};
+        std::size_t max_queue_depth = 1000;
+        // told to clients whose requests are shed
+        std::chrono::seconds retry_after{2};
+    };
+
+    struct OverloadStats {
+        bool overloaded = false;
+        // worst loop lag across reactors, smoothed
+        std::chrono::microseconds loop_lag{0};
+        std::size_t queue_depth = 0;
+        // times the server became overloaded
+        std::uint64_t episodes = 0;
+        std::uint64_t shed = 0;
+    };
+
+    struct ZerocopyStats {
+        // zerocopy sends the kernel reported done
+        std::uint64_t completed = 0;
+        // of those, the ones it had to copy anyway
+        std::uint64_t copied = 0;
+    };
+
+    // How often each limit was hit.
+    struct LimitStats {
+        std::uint64_t header_too_large = 0;
+        std::uint64_t body_too_large = 0;
+        std::uint64_t frame_too_large = 0;
+        std::uint64_t output_too_large = 0;
+        std::uint64_t too_slow = 0;
+    };
+
   protected:
-    TcpSocket server_socket;
-    ThreadPool thread_pool;
+    // Chunks of the send queue handed to io_uring as one linked chain of
+    // sends. Kept alive by the operations that point into it until the
+    // kernel is done with them.
+    struct SendChain {
+        std::vector<std::string> chunks;
+        std::size_t bytes = 0;
+        std::size_t outstanding = 0;
+        // position of the first byte that was not sent, chunks.size() if none
+        std::size_t unsent_chunk = 0;
+        std::size_t unsent_offset = 0;
+        int error = 0;
+    };
+
+    // Buffers of a closed socket's zerocopy sends, see ZEROCOPY_RETIRE_SECONDS.
+    struct RetiredBuffers {
+        std::chrono::steady_clock::time_point until;
+        std::vector<std::shared_ptr<const std::string>> buffers;
+    };
+
+    // An in-flight recv or send keyed by its io_uring user_data.
+    struct UringOp {
+        int fd;
+        // null for the multishot recv of the socket
+        std::shared_ptr<SendChain> chain;
+        std::size_t chunk = 0;
+        std::size_t offset = 0;
+        std::size_t length = 0;
+    };
+
+    enum class Limit {
+        HEADER,
+        BODY,
+        FRAME,
+        OUTPUT,
+        DATA_RATE,
+        COUNT,
+    };
+
+    static constexpr std::uint64_t URING_ACCEPT_OP = 1;
+    static constexpr std::uint64_t URING_WAKEUP_OP = 2;
+    static constexpr std::uint64_t URING_FIRST_OP = 16;
+
+    // One event loop with its own SO_REUSEPORT listener. The kernel spreads
+    // incoming connections across the listeners, so a connection lives on
+    // exactly one reactor for its whole lifetime.
+    struct Reactor {
+        int id;
+        TcpSocket server_socket;
+        int epoll_fd = -1;
+        std::optional<int> cpu;
+        std::array<struct epoll_event, MAX_EVENTS> events;
+        std::thread thread;
+        TimingWheel idle_timers;
+        // cleared while a handoff holds new connections back in the backlog
+        bool accepting = true;
+        // set while connections are being detached, keeps their reads paused
+        bool detaching = false;
+        // Time the loop spends handling one batch of ready events, smoothed.
+        // An event that became ready while the loop was busy waits about
+        // this long before it is handled. Read by other reactors.
+        std::atomic<std::int64_t> loop_lag_us{0};
+
+        // closures posted from other threads, job results included, so all
+        // socket writes stay on the loop thread
+        Mailbox mailbox;
+        // sockets written to by the current mailbox batch, flushed after it
+        std::vector<ConnectionHandle> pending_flush;
+        // messages handed to the pool whose completion was not processed yet
+        std::unordered_map<int, std::size_t> jobs_in_flight;
+        // sockets closed while jobs were still in flight; the fd is kept open
+        // until the last completion arrives so it cannot be reused meanwhile
+        std::unordered_set<int> closing;
+        // oldest first
+        std::deque<RetiredBuffers> zerocopy_retired;
+
+        // io_uring backend, null when the reactor runs on epoll
+        std::unique_ptr<IoUring> ring;
+        std::uint64_t next_user_data = URING_FIRST_OP;
+        std::unordered_map<std::uint64_t, UringOp> uring_ops;
+        // user_data of the multishot recv armed for each socket, including
+        // one that is being cancelled because reads are paused
+        std::unordered_map<int, std::uint64_t> recv_ops;
+        // at most one send chain per socket is in flight, later writes queue up behind it
+        std::unordered_map<int, std::shared_ptr<SendChain>> send_chains;
+    };
+
     std::chrono::seconds client_timeout;
-    std::thread server_thread;
-    int epoll_fd;
-    std::array<struct epoll_event, MAX_EVENTS> events;
-    std::unordered_map<int, TcpSocket> connections;
+    std::size_t reactor_count = 1;
+    int cpu_offset = 0;
+    IoBackend io_backend = IoBackend::EPOLL;
+    std::size_t send_low_watermark = 256 * 1024;
+    std::size_t send_high_watermark = 1024 * 1024;
+    int listen_backlog = SOMAXCONN;
+    SocketOptions socket_options;
+    std::shared_ptr<TlsContext> tls;
+    std::chrono::microseconds busy_poll_spin{0};
+    std::size_t zerocopy_threshold = 0;
+    std::atomic<std::uint64_t> zerocopy_completed{0};
+    std::atomic<std::uint64_t> zerocopy_copied{0};
+    Limits limits;
+    std::unique_ptr<AdmissionQueue> admission;
+    std::chrono::seconds retry_jitter{0};
+    std::atomic<std::uint64_t> admissions_delayed{0};
+    std::atomic<std::uint64_t> admissions_refused{0};
+    OverloadPolicy overload_policy;
+    std::atomic<bool> overloaded{false};
+    std::atomic<std::uint64_t> overload_episodes{0};
+    std::atomic<std::uint64_t> shed_messages{0};
+    std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Limit::COUNT)> limit_hits{};
+    std::atomic<bool> running{false};
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    // every reactor's connections, each reactor owning the slots of its own
+    ConnectionTable connections;
+    std::vector<int> inherited_listeners;
+    // declared after reactors so workers are joined before reactors go away
+    ThreadPool thread_pool;
     Logger& logger = Logger::instance();
-    void run_loop();
+    void run_loop(Reactor& reactor);
+    void run_epoll_loop(Reactor& reactor);
+    Result<int> add_listener(Reactor& reactor);
+    // Waits for the next batch, polling first when busy polling is on.
+    int wait_epoll(Reactor& reactor);
+    Result<int> wait_uring(Reactor& reactor);
+    void run_uring_loop(Reactor& reactor);
   
 
     virtual Result<std::string> handle_message(TcpSocket& socket, std::string message) = 0;
+    // Called on the loop thread for every message before it is handed to the
+    // pool and for the incomplete input left behind. Returns what to answer
+    // with if the input is over a limit; the input is then dropped and the
+    // connection closed once the answer is written.
+    virtual std::optional<std::string> check_limits(TcpSocket& client_socket, std::string_view input);
+    void count_limit(Limit limit);
+    // Called on the loop thread for each message while the server is
+    // overloaded. Returns the cheap answer to send instead of handling the
+    // message, nullopt to handle it anyway. Setting CLOSE_AFTER_RESPONSE on
+    // the socket makes the answer its last.
+    virtual std::optional<std::string> shed_message(TcpSocket& client_socket, std::string_view message);
+    // Called on the loop thread for each message handed to the pool, picks
+    // the lane it waits in. NORMAL unless overridden.
+    virtual Priority message_priority(TcpSocket& client_socket, std::string_view message);
+    void record_loop_lag(Reactor& reactor, std::chrono::steady_clock::duration busy);
+    bool is_overloaded();
+    // What a connection refused by the admission queue is sent before it
+    // is closed.
+    virtual std::string retry_later_response(std::chrono::seconds retry_after);
 
 
     virtual void drain_and_close(TcpSocket& client_socket);
@@ -31,11 +269,59 @@ class TcpServer {
     virtual void write_until_eagain(TcpSocket& client_socket);
     virtual void handle_error(TcpSocket& client_socket);
     virtual void on_client_connected(TcpSocket& client_socket) = 0;
+    // Called when a connection has been idle for client_timeout. Returning
+    // false keeps it open for another timeout period.
+    virtual bool on_client_idle(TcpSocket& client_socket);
 
-    void handle_socket_close(TcpSocket& client_socket);
-    void close_idle_connections();
-    void handle_server_event();
-    void handle_client_event(int fd,uint32_t events);
+    Reactor& reactor_of(const TcpSocket& client_socket);
+    void handle_job(ConnectionHandle handle, std::string message);
+    // last: the response closes the connection, see CLOSE_AFTER_RESPONSE.
+    void complete_job(Reactor& reactor, ConnectionHandle handle, Result<std::string>& response, bool last);
+    void drain_mailbox(Reactor& reactor);
+    // Queues a write of what was appended to the socket's send buffer; runs
+    // once after the mailbox batch so a burst of posts needs one send.
+    void schedule_flush(TcpSocket& client_socket);
+    void flush_pending(Reactor& reactor);
+    void reject_input(Reactor& reactor, TcpSocket& client_socket, std::string response);
+    // Upper bound of a message within the limits, reads stop there.
+    std::size_t max_unread_bytes() const;
+    bool is_too_slow(const TcpSocket& client_socket, std::chrono::steady_clock::time_point now) const;
+    void handle_socket_close(TcpSocket& client_socket, bool hard = false);
+    void finish_deferred_close(Reactor& reactor, ConnectionHandle handle);
+    // Returns false if the socket turned out to have failed.
+    bool reap_zerocopy(TcpSocket& client_socket);
+    // Keeps the buffers of a departing socket's unfinished zerocopy sends
+    // alive, the kernel may still be reading them.
+    void retire_zerocopy(Reactor& reactor, TcpSocket& client_socket);
+    void release_retired_zerocopy(Reactor& reactor, std::chrono::steady_clock::time_point now);
+    void arm_idle_timer(Reactor& reactor, TcpSocket& client_socket, std::chrono::steady_clock::time_point deadline);
+    void close_idle_connections(Reactor& reactor);
+    int next_wakeup_ms(Reactor& reactor);
+    void handle_server_event(Reactor& reactor);
+    // Adds a freshly accepted connection, through the admission queue if
+    // there is one.
+    void accept_connection(Reactor& reactor, TcpSocket client_socket);
+    void admit_connection(Reactor& reactor, TcpSocket& client_socket);
+    void handle_client_event(Reactor& reactor, ConnectionHandle handle, uint32_t events);
+    ConnectionHandle add_connection(Reactor& reactor, TcpSocket client_socket);
+    void dispatch_messages(TcpSocket& client_socket);
+    std::size_t queued_send_bytes(Reactor& reactor, const TcpSocket& client_socket) const;
+    void apply_backpressure(Reactor& reactor, TcpSocket& client_socket);
+
+    bool setup_uring(Reactor& reactor);
+    void arm_uring_recv(Reactor& reactor, int fd);
+    void pause_uring_recv(Reactor& reactor, int fd);
+    void submit_uring_send(Reactor& reactor, TcpSocket& client_socket);
+    void release_uring_ops(Reactor& reactor, int fd);
+    void handle_uring_completion(Reactor& reactor, const IoUring::Completion& completion);
+    void handle_uring_accept(Reactor& reactor, const IoUring::Completion& completion);
+    void handle_uring_receive(Reactor& reactor, const IoUring::Completion& completion, int fd);
+    void handle_uring_send(Reactor& reactor, const IoUring::Completion& completion, UringOp op);
+    void pin_to_cpu(const Reactor& reactor);
+    // Runs task on every reactor's loop thread and waits until all of them
+    // ran it. Before run() it runs on the caller's thread instead.
+    void run_on_reactors(const std::function<void(Reactor&)>& task);
+    DetachedConnection detach_connection(Reactor& reactor, ConnectionHandle handle);
 
 
     
@@ -46,11 +332,114 @@ class TcpServer {
     TcpServer();
     virtual ~TcpServer();
 
+    // address is an IPv4 address, or unix:/path for an AF_UNIX listener
+    // that ignores port. The socket file is not removed on stop: after a
+    // handoff the next process is still listening on it.
     void start(int port, std::string address);
     void stop();
+    static bool is_unix_address(const std::string& address);
+    // host:port, or the unix: address as given
+    static std::string describe_address(int port, const std::string& address);
     void run();
     
     void set_client_timeout(std::chrono::seconds timeout);
     std::chrono::milliseconds get_client_timeout() const;
 
-};
\ No newline at end of file
+    // Must be called before start(). With more than one reactor every loop
+    // thread is pinned to its own CPU, counted from cpu_offset.
+    void set_reactor_count(std::size_t count, int cpu_offset = 0);
+    std::size_t get_reactor_count() const;
+
+    // Must be called before run(). A reactor whose io_uring cannot be set up
+    // falls back to epoll.
+    void set_io_backend(IoBackend backend);
+    IoBackend get_io_backend() const;
+
+    // Reading from a connection stops once its unsent output reaches the
+    // high watermark and resumes when it has drained to the low watermark.
+    void set_send_watermarks(std::size_t low, std::size_t high);
+    bool is_above_high_watermark(const TcpSocket& client_socket);
+    bool is_below_low_watermark(const TcpSocket& client_socket);
+
+    // Must be called before start().
+    void set_listen_backlog(int backlog);
+    // Must be called before start(). Applied to the listeners, fresh or
+    // inherited, and through them to every connection accepted.
+    void set_socket_options(const SocketOptions& options);
+
+    // Must be called before run(). Every accepted connection is wrapped in
+    // TLS. Reactors of a TLS server run on epoll whatever the backend, since
+    // io_uring would complete receives with ciphertext. TLS connections are
+    // not handed off: detach_connections() closes them and the clients
+    // resume their sessions on reconnect.
+    void set_tls(std::shared_ptr<TlsContext> context);
+
+    // Must be called before start(). Before each blocking wait a reactor
+    // polls for events without sleeping for up to spin, or until its next
+    // timer is due, so a request arriving in that window is picked up
+    // without a wakeup. Costs a core per reactor while traffic lasts; every
+    // reactor is pinned, a single one included. Zero, the default, always
+    // blocks. NIC level polling is the listeners' busy_poll socket option.
+    void set_busy_poll(std::chrono::microseconds spin);
+
+    // Must be called before run(). Shared buffers of at least threshold
+    // bytes, i.e. broadcasts, are sent with MSG_ZEROCOPY to connections
+    // accepted on epoll reactors, over TCP and without TLS; zero turns it
+    // off. Adopted connections are left out, the kernel numbers zerocopy
+    // sends per socket and this process does not know where it stands.
+    void set_zerocopy_threshold(std::size_t threshold);
+    ZerocopyStats get_zerocopy_stats() const;
+
+    // Must be called before run(). New connections are read from at most
+    // rate per second, after a burst; up to max_waiting more wait their
+    // turn and the rest are refused, told to retry after the queue has
+    // drained plus up to retry_jitter.
+    void set_admission(double rate, std::size_t burst, std::size_t max_waiting, std::chrono::seconds retry_jitter);
+    AdmissionStats get_admission_stats() const;
+
+    // Must be called before run().
+    void set_overload_policy(const OverloadPolicy& policy);
+    const OverloadPolicy& get_overload_policy() const;
+    // Re-evaluates the overload state, which is otherwise only updated
+    // when messages arrive.
+    OverloadStats get_overload_stats();
+
+    // Must be called before run().
+    void set_limits(const Limits& limits);
+    const Limits& get_limits() const;
+    LimitStats get_limit_stats() const;
+
+    ThreadPool::Stats get_pool_stats() const;
+    // Queueing delay per priority lane, see ThreadPool::get_lane_stats().
+    std::array<ThreadPool::LaneStats, PRIORITY_COUNT> get_lane_stats();
+    // Walks every connection on its loop thread.
+    ConnectionStats get_connection_stats();
+
+    // Runs task on the loop thread of the given reactor. Safe to call from
+    // any thread once start() has returned.
+    void post(int reactor_id, Mailbox::Task task);
+    // Runs visit on every reactor's loop thread for each of its open
+    // connections.
+    void post_to_connections(std::function<void(TcpSocket&)> visit);
+
+    // Binary upgrade support. None of these may be called from a loop thread.
+    //
+    // Must be called before start(): the reactors serve these listening
+    // sockets instead of binding new ones, one reactor per socket.
+    void adopt_listeners(std::vector<int> fds);
+    std::vector<int> get_listener_fds() const;
+    // The listeners stay open while paused, so new connections wait in the
+    // backlog instead of being refused.
+    void pause_accepting();
+    void resume_accepting();
+    // Pauses reads on every connection and takes off those that settled: no
+    // job in flight and, on io_uring, no recv or send left in the kernel.
+    // With force only running jobs hold a connection back. remaining is set
+    // to the number of connections left behind.
+    std::vector<DetachedConnection> detach_connections(bool force, std::size_t& remaining);
+    // Lets the connections that were not detached read again.
+    void cancel_detach();
+    void adopt_connection(DetachedConnection connection);
+    std::size_t count_connections();
+
+};
@@ -1,14 +1,22 @@
 #include "server/server/tcp_socket.h"
+#include "server/server/tls_context.h"
 
 #include <arpa/inet.h>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
 #include <poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include <cerrno>
 #include <chrono>
+#include <climits>
+#include <cstring>
 #include <fcntl.h>
 
 
@@ -30,15 +38,9 @@ TcpSocket::TcpSocket()
 }
 
 TcpSocket::TcpSocket(int socket_fd, const std::string& host, int port)
-    :  host(host),
-       port(port),
-       socket_fd(socket_fd),
+    :  socket_fd(socket_fd),
        last_activity(std::chrono::steady_clock::now()) {
-
-    int opt = 1;
-    setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    int flags = fcntl(socket_fd, F_GETFL, 0);
-    fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+    set_peer(host, port);
 }
 
 
@@ -49,9 +51,8 @@ Result<int> TcpSocket::check_connected(std::string message) const {
     );
 }
 
-Result<TcpSocket> TcpSocket::listen(const std::string& host, int port, int max_connections) {
-    this->host = host;
-    this->port = port;
+Result<TcpSocket> TcpSocket::listen(const std::string& host, int port, int backlog) {
+    set_peer(host, port);
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
@@ -64,7 +65,7 @@ Result<TcpSocket> TcpSocket::listen(const std::string& host, int port, int max_c
             "Failed to create socket"
         )
         .chain_from_bsd(
-            ::listen(socket_fd, max_connections), 
+            ::listen(socket_fd, backlog), 
             "Failed to listen on socket"
         )
         .finally<TcpSocket>([&]() {
@@ -72,6 +73,76 @@ Result<TcpSocket> TcpSocket::listen(const std::string& host, int port, int max_c
         });
 }
 
+Result<TcpSocket> TcpSocket::listen_unix(const std::string& path, int backlog, const SocketOptions& options) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return Result<TcpSocket>(Error("Invalid unix socket path: " + path));
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) return Result<TcpSocket>(Error("Failed to create unix socket"));
+    TcpSocket listener(fd, "", 0);
+    listener.set_flag(UNIX_DOMAIN);
+    listener.apply_options(options);
+
+    // a socket file outlives the process that bound it; anything else at
+    // path is left alone and makes bind fail
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path.c_str());
+    }
+    auto result = Result<int>::from_bsd(
+        bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)),
+        "Failed to bind unix socket " + path
+    ).chain_from_bsd(
+        ::listen(fd, backlog),
+        "Failed to listen on unix socket " + path
+    );
+    if (result.is_err()) {
+        Error error("Failed to listen on unix socket " + path);
+        ::close(fd);
+        return Result<TcpSocket>(std::move(error));
+    }
+    return Result<TcpSocket>(listener);
+}
+
+void TcpSocket::apply_options(const SocketOptions& options) {
+    auto set = [this](int level, int name, const std::string& label, int value) {
+        Result<int>::from_bsd(
+            setsockopt(socket_fd, level, name, &value, sizeof(value)),
+            "Failed to set " + label + " on " + socket_info()
+        ).log_warn();
+    };
+    if (is_unix_domain()) {
+        // only the buffer sizes mean anything without TCP
+        if (options.receive_buffer) set(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", *options.receive_buffer);
+        if (options.send_buffer) set(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", *options.send_buffer);
+        return;
+    }
+    if (options.tcp_nodelay) set(IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", *options.tcp_nodelay);
+    if (options.defer_accept_seconds) set(IPPROTO_TCP, TCP_DEFER_ACCEPT, "TCP_DEFER_ACCEPT", *options.defer_accept_seconds);
+    if (options.fastopen_queue) set(IPPROTO_TCP, TCP_FASTOPEN, "TCP_FASTOPEN", *options.fastopen_queue);
+    if (options.receive_buffer) set(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", *options.receive_buffer);
+    if (options.send_buffer) set(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", *options.send_buffer);
+    if (options.notsent_lowat) set(IPPROTO_TCP, TCP_NOTSENT_LOWAT, "TCP_NOTSENT_LOWAT", *options.notsent_lowat);
+    // raising it above net.core.busy_read needs CAP_NET_ADMIN
+    if (options.busy_poll_us) set(SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL", *options.busy_poll_us);
+    if (options.keepalive) set(SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", *options.keepalive);
+    if (options.keepalive_idle_seconds) set(IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE", *options.keepalive_idle_seconds);
+    if (options.keepalive_interval_seconds) set(IPPROTO_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL", *options.keepalive_interval_seconds);
+    if (options.keepalive_probes) set(IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT", *options.keepalive_probes);
+}
+
+Result<int> TcpSocket::set_reuse_port() {
+    int opt = 1;
+    return check_connected("Socket not connected while setting SO_REUSEPORT")
+        .chain_from_bsd(
+            setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)),
+            "Failed to set SO_REUSEPORT"
+        );
+}
 
 Result<void*> TcpSocket::hard_close() {
     return check_connected("Socket not connected while disconnecting")
@@ -84,9 +155,10 @@ Result<void*> TcpSocket::hard_close() {
         "Failed to close socket"
     )
     .finally<void*>([&]() {
+        free_tls();
         this->socket_fd = -1;
-        host.reset();
-        port.reset();
+        peer_address = 0;
+        peer_port = 0;
         return nullptr;
     });
 }
@@ -99,7 +171,34 @@ Result<int> TcpSocket::shutdown_read() {
     );
 }
 
+Result<int> TcpSocket::shutdown_write() {
+    // close_notify, best effort: the peer learns the close was intended
+    if (tls != nullptr && SSL_is_init_finished(tls)) {
+        SSL_shutdown(tls);
+        ERR_clear_error();
+    }
+    return check_connected("Socket not connected while shutting down write")
+    .chain_from_bsd(
+        shutdown(this->socket_fd, SHUT_WR),
+        "Failed to shutdown socket"
+    );
+}
+
+Result<int> TcpSocket::shutdown_read_write() {
+    return check_connected("Socket not connected while shutting down")
+    .chain_from_bsd(
+        shutdown(this->socket_fd, SHUT_RDWR),
+        "Failed to shutdown socket"
+    );
+}
+
 Result<int> TcpSocket::close() {
+    if (tls != nullptr) {
+        // an orderly close; without this SSL_free takes the session for a
+        // broken one and drops it from the resumption cache
+        SSL_set_shutdown(tls, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+    free_tls();
     return check_connected("Socket not connected while closing")
     .chain_from_bsd(
         ::close(this->socket_fd),
@@ -107,26 +206,76 @@ Result<int> TcpSocket::close() {
     );
 }
 
-void TcpSocket::set_send_buffer(std::string data) {
-    send_buffer = data;
+void TcpSocket::append_send_buffer(std::string data) {
+    send_queue.push(std::move(data));
+}
+
+void TcpSocket::append_send_buffer(std::shared_ptr<const std::string> data) {
+    send_queue.push(std::move(data));
+}
+
+Result<int> TcpSocket::enable_zerocopy(std::size_t threshold) {
+    int one = 1;
+    return check_connected("Socket not connected while enabling zerocopy")
+    .chain_from_bsd(
+        setsockopt(socket_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)),
+        "Failed to set SO_ZEROCOPY"
+    )
+    .chain<int>([&](int) {
+        send_queue.enable_zerocopy(threshold);
+        return Result<int>(0);
+    });
+}
+
+Result<ZerocopyCompletions> TcpSocket::reap_zerocopy() {
+    ZerocopyCompletions completions;
+    while (true) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr message = {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(socket_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return Result<ZerocopyCompletions>(Error("Failed to read the socket error queue"));
+        }
+        for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+             header = CMSG_NXTHDR(&message, header)) {
+            bool extended_error = (header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) ||
+                                  (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR);
+            if (!extended_error) continue;
+            struct sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+            if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY || error.ee_errno != 0) continue;
+            // ee_info to ee_data, the range of sends that completed
+            std::size_t sends = send_queue.complete_zerocopy(error.ee_info, error.ee_data);
+            completions.sends += sends;
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) completions.copied += sends;
+        }
+    }
+    if (completions.copied > 0) send_queue.disable_zerocopy();
+
+    int pending = 0;
+    socklen_t length = sizeof(pending);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &pending, &length) == 0 && pending != 0) {
+        errno = pending;
+        return Result<ZerocopyCompletions>(Error("Socket error"));
+    }
+    return Result<ZerocopyCompletions>(completions);
 }
 
 Result<bool> TcpSocket::send() {
 
     //return true if send buffer is empty
  
-    
+    // with kTLS the kernel encrypts what the plain path writes
+    if (tls != nullptr && !BIO_get_ktls_send(SSL_get_wbio(tls))) {
+        return send_tls();
+    }
     return check_connected("Socket not connected while sending")
     .chain<bool>([&](int _) {
 
-        while(true) {
-            int result = ::send(this->socket_fd, send_buffer.c_str(), send_buffer.size(), 0);
-            touch();
-            send_buffer.erase(0, result);
-            
-            if(send_buffer.empty()) {
-                return Result<bool>(false);
-            }
+        while(!send_queue.empty()) {
+            ssize_t result = send_queue.write_to(this->socket_fd);
 
             if(result < 0) {
 
@@ -135,10 +284,8 @@ Result<bool> TcpSocket::send() {
                 }
                 return Result<bool>(Error("Failed to send data"));
             }
-
-            touch();
-            send_buffer.erase(0, result);
         }
+        return Result<bool>(false);
     });
 
 
@@ -147,10 +294,33 @@ Result<bool> TcpSocket::send() {
 
 void TcpSocket::drain_buffer() {
     recv_buffer.clear();
+    framing = FramingState();
+}
+
+void TcpSocket::release_buffers() {
+    recv_buffer.release();
+    send_queue.release();
+}
+
+std::size_t TcpSocket::memory_usage() const {
+    return sizeof(TcpSocket) + recv_buffer.capacity() + send_queue.capacity();
 }
 
 Result<bool> TcpSocket::drain() {
     char buffer[4096];
+    if (tls != nullptr) {
+        // input still has to be decrypted, the handshake included, for a
+        // rejection queued on a fresh connection to go out
+        while (true) {
+            ERR_clear_error();
+            int n = SSL_read(tls, buffer, sizeof(buffer));
+            if (n > 0) continue;
+            int error = SSL_get_error(tls, n);
+            if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) return Result<bool>(false);
+            if (error == SSL_ERROR_ZERO_RETURN) return Result<bool>(true);
+            return Result<bool>(Error("TLS error while draining: " + last_ssl_error()));
+        }
+    }
 
     return check_connected("Socket not connected while draining")
     .chain<bool>([&](int _) {
@@ -173,16 +343,17 @@ Result<bool> TcpSocket::drain() {
     });
 }
 
-Result<bool> TcpSocket::receive() {
+Result<bool> TcpSocket::receive(std::size_t max_unread) {
     //returns true if received EOF
-    char buffer[1024];
-   
+    if (tls != nullptr) {
+        return receive_tls(max_unread);
+    }
 
     return check_connected("Socket not connected while receiving")
     .chain<bool>([&](int _) {
 
         while(true) {
-            int result = ::recv(this->socket_fd, buffer, 1024, 0);
+            ssize_t result = recv_buffer.read_from(this->socket_fd);
             touch();
 
             if(result == 0) {
@@ -195,47 +366,203 @@ Result<bool> TcpSocket::receive() {
                 };
                 return Result<bool>(Error("Failed to receive data"));
             }
-
-            recv_buffer.append(buffer, result);
+            if(recv_buffer.size() >= max_unread) {
+                return Result<bool>(false);
+            }
         }
 
     });
 }
 
+Result<int> TcpSocket::start_tls(SSL_CTX* context) {
+    tls = SSL_new(context);
+    if (tls == nullptr) {
+        return Result<int>(Error("Failed to create TLS session: " + last_ssl_error()));
+    }
+    if (SSL_set_fd(tls, socket_fd) != 1) {
+        free_tls();
+        return Result<int>(Error("Failed to attach TLS session: " + last_ssl_error()));
+    }
+    SSL_set_accept_state(tls);
+    return Result<int>(0);
+}
+
+void TcpSocket::free_tls() {
+    if (tls == nullptr) return;
+    SSL_free(tls);
+    tls = nullptr;
+}
+
+// SSL_read runs the handshake until it is done, so the first reads may
+// produce no plaintext at all.
+Result<bool> TcpSocket::receive_tls(std::size_t max_unread) {
+    char buffer[16384];
+    while (true) {
+        ERR_clear_error();
+        int result = SSL_read(tls, buffer, sizeof(buffer));
+        touch();
+
+        if (result > 0) {
+            recv_buffer.append(buffer, static_cast<std::size_t>(result));
+            if (recv_buffer.size() >= max_unread) {
+                return Result<bool>(false);
+            }
+            continue;
+        }
+        switch (SSL_get_error(tls, result)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                return Result<bool>(false);
+            case SSL_ERROR_ZERO_RETURN:
+                return Result<bool>(true);
+            case SSL_ERROR_SYSCALL:
+                return Result<bool>(Error("Failed to receive data"));
+            default:
+                return Result<bool>(Error("TLS error while receiving: " + last_ssl_error()));
+        }
+    }
+}
+
+// One chunk per SSL_write. A write that could not finish is retried with
+// the same front chunk, which SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER allows.
+Result<bool> TcpSocket::send_tls() {
+    while (!send_queue.empty()) {
+        std::string_view front = send_queue.front();
+        ERR_clear_error();
+        int result = SSL_write(tls, front.data(), static_cast<int>(std::min<std::size_t>(front.size(), INT_MAX)));
+        if (result > 0) {
+            send_queue.consume(static_cast<std::size_t>(result));
+            continue;
+        }
+        switch (SSL_get_error(tls, result)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                return Result<bool>(false);
+            case SSL_ERROR_SYSCALL:
+                return Result<bool>(Error("Failed to send data"));
+            default:
+                return Result<bool>(Error("TLS error while sending: " + last_ssl_error()));
+        }
+    }
+    return Result<bool>(false);
+}
+
+Result<bool> TcpSocket::complete_receive(int result, const char* data) {
+    if(result < 0) {
+        errno = -result;
+        return Result<bool>(Error("Failed to receive data"));
+    }
+    touch();
+    if(result == 0) {
+        return Result<bool>(true);
+    }
+    recv_buffer.append(data, result);
+    return Result<bool>(false);
+}
+
+std::vector<std::string> TcpSocket::take_send_queue() {
+    return send_queue.take();
+}
+
+void TcpSocket::requeue_send(std::string unsent) {
+    send_queue.push_front(std::move(unsent));
+}
+
 std::vector<std::string> TcpSocket::flush_messages() {
     //protocol callback should return the next message to be processed or nullopt if no full message is detected
     std::vector<std::string> messages;
-    if(!protocol_callback){
+    ProtocolCallback callback = protocol_callback.load();
+    if(!callback){
         Logger::instance().error("Protocol callback is not set");
         return messages;
     }
     while(true) {
-        
-        auto data_message = protocol_callback(recv_buffer);
-        if(!data_message.has_value()) return messages;
-        recv_buffer.erase(0, data_message->size());
-        messages.push_back(*data_message);
+        auto length = callback(recv_buffer.view(), framing);
+        if(!length.has_value()) return messages;
+        messages.emplace_back(recv_buffer.view().substr(0, *length));
+        recv_buffer.consume(*length);
+        framing = FramingState();
     }
 }
 
+std::string TcpSocket::take_unread() {
+    std::string unread(recv_buffer.view());
+    recv_buffer.clear();
+    framing = FramingState();
+    return unread;
+}
+
+void TcpSocket::restore_unread(std::string_view data) {
+    recv_buffer.append(data);
+}
+
+// Wraps fd with the address in addr, which getpeername, getsockname or
+// accept filled in.
+static TcpSocket wrap_socket(int fd, const struct sockaddr_storage& addr) {
+    if (addr.ss_family == AF_UNIX) {
+        TcpSocket socket(fd, "", 0);
+        socket.set_flag(TcpSocket::UNIX_DOMAIN);
+        return socket;
+    }
+    const auto& inet = reinterpret_cast<const struct sockaddr_in&>(addr);
+    return TcpSocket(fd, inet_ntoa(inet.sin_addr), ntohs(inet.sin_port));
+}
+
 Result<TcpSocket> TcpSocket::accept() {
-    struct sockaddr_in client_addr;
+    struct sockaddr_storage client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
 
     return check_connected("Socket not connected while accepting")
     .chain_from_bsd(
-        ::accept(
+        ::accept4(
             this->socket_fd,
             (struct sockaddr*)&client_addr,
-            &client_addr_len
+            &client_addr_len,
+            SOCK_NONBLOCK | SOCK_CLOEXEC
             ), 
         "Failed to accept socket"
     )
     .finally<TcpSocket>([&](int client_fd) {
-        return TcpSocket(client_fd, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        TcpSocket client = wrap_socket(client_fd, client_addr);
+        client.read_peer_credentials();
+        return client;
+    });
+}
+
+Result<TcpSocket> TcpSocket::from_accepted_fd(int client_fd) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+
+    return Result<int>::from_bsd(
+        getpeername(client_fd, (struct sockaddr*)&client_addr, &client_addr_len),
+        "Failed to read peer address of accepted socket"
+    )
+    .finally<TcpSocket>([&]() {
+        TcpSocket client = wrap_socket(client_fd, client_addr);
+        client.read_peer_credentials();
+        return client;
+    });
+}
+
+Result<TcpSocket> TcpSocket::from_listening_fd(int listen_fd) {
+    struct sockaddr_storage listen_addr;
+    socklen_t listen_addr_len = sizeof(listen_addr);
+
+    return Result<int>::from_bsd(
+        getsockname(listen_fd, (struct sockaddr*)&listen_addr, &listen_addr_len),
+        "Failed to read address of inherited listener"
+    )
+    .finally<TcpSocket>([&]() {
+        return wrap_socket(listen_fd, listen_addr);
     });
 }
 
+void TcpSocket::set_peer(const std::string& host, int port) {
+    struct in_addr address;
+    peer_address = inet_pton(AF_INET, host.c_str(), &address) == 1 ? address.s_addr : 0;
+    peer_port = static_cast<std::uint16_t>(port);
+}
+
 void TcpSocket::touch() {
     last_activity = std::chrono::steady_clock::now();
 }
@@ -250,13 +577,46 @@ int TcpSocket::get_fd() const {
     return socket_fd;
 }
 std::optional<std::string> TcpSocket::get_host() const {
-    return host;
+    if (peer_port == 0) return std::nullopt;
+    char host[INET_ADDRSTRLEN];
+    struct in_addr address;
+    address.s_addr = peer_address;
+    inet_ntop(AF_INET, &address, host, sizeof(host));
+    return std::string(host);
 }
 
 std::optional<int> TcpSocket::get_port() const {
-    return port;
+    if (peer_port == 0) return std::nullopt;
+    return peer_port;
+}
+
+void TcpSocket::read_peer_credentials() {
+    if (!is_unix_domain()) return;
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1) return;
+    peer_address = static_cast<std::uint32_t>(credentials.pid);
+    peer_uid = static_cast<std::uint32_t>(credentials.uid);
+}
+
+std::optional<PeerCredentials> TcpSocket::get_peer_credentials() const {
+    // a listener, or a peer the kernel knows nothing of, has pid 0
+    if (!is_unix_domain() || peer_address == 0) return std::nullopt;
+    return PeerCredentials{static_cast<pid_t>(peer_address), static_cast<uid_t>(peer_uid)};
 }
 
 std::string TcpSocket::socket_info() const {
-    return  host.value_or("unknown") + ":" + std::to_string(port.value_or(0));
+    if (is_unix_domain()) {
+        auto credentials = get_peer_credentials();
+        if (credentials) {
+            return "unix:pid=" + std::to_string(credentials->pid) +
+                   ",uid=" + std::to_string(credentials->uid);
+        }
+        // a listener has no peer; its own path names it
+        struct sockaddr_un addr = {};
+        socklen_t length = sizeof(addr);
+        getsockname(socket_fd, reinterpret_cast<struct sockaddr*>(&addr), &length);
+        return std::string("unix:") + addr.sun_path;
+    }
+    return  get_host().value_or("unknown") + ":" + std::to_string(get_port().value_or(0));
 }
\ No newline at end of file
@@ -1,79 +1,359 @@
 #pragma once
 
+#include "server/server/byte_buffer.h"
+#include "server/server/connection_handle.h"
+#include "server/server/send_queue.h"
+#include "server/server/socket_options.h"
 #include "server/utils/result.h"
 
+#include <openssl/ssl.h>
+
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// Where a connection is in its protocol. WebSocket connections start out
+// in HTTP for the handshake request.
+enum class ConnectionPhase : std::uint8_t {
+  HTTP,
+  WEBSOCKET,
+};
+
+// std::atomic that can be copied and moved along with the socket that holds
+// it. Sockets are only copied or moved while no other thread uses them.
+template <typename T>
+class SocketAtomic {
+  public:
+    SocketAtomic(T value = T()) : value(value) {}
+    SocketAtomic(const SocketAtomic& other) : value(other.load()) {}
+    SocketAtomic& operator=(const SocketAtomic& other) {
+      store(other.load());
+      return *this;
+    }
+    T load() const {
+      return value.load(std::memory_order_acquire);
+    }
+    void store(T next) {
+      value.store(next, std::memory_order_release);
+    }
+    T fetch_or(T bits) {
+      return value.fetch_or(bits, std::memory_order_acq_rel);
+    }
+    T fetch_and(T bits) {
+      return value.fetch_and(bits, std::memory_order_acq_rel);
+    }
+    T fetch_add(T amount) {
+      return value.fetch_add(amount, std::memory_order_acq_rel);
+    }
+
+  private:
+    std::atomic<T> value;
+};
+
+// Zerocopy sends the kernel reported done, see TcpSocket::reap_zerocopy().
+struct ZerocopyCompletions {
+  std::size_t sends = 0;
+  // of those, the ones the kernel ended up copying after all
+  std::size_t copied = 0;
+};
+
+// Who is on the other end of an AF_UNIX connection, from SO_PEERCRED.
+struct PeerCredentials {
+  pid_t pid;
+  uid_t uid;
+};
+
+// Progress of a protocol callback through a message that has not fully
+// arrived, so the next read resumes where the last one stopped. Reset each
+// time a message is taken.
+struct FramingState {
+  // bytes of the unread input already searched
+  std::uint32_t scanned = 0;
+  // length of the message once known, 0 before
+  std::uint32_t length = 0;
+};
 
+// Kept small because every idle WebSocket spectator holds one: protocol state
+// is a phase and a byte of flags, the peer address is stored raw and only
+// formatted for logs, and both buffers allocate on first use and give their
+// storage back when release_buffers() finds them empty.
 class TcpSocket {
+  public:
+    using ProtocolCallback = std::optional<std::size_t> (*)(std::string_view, FramingState&);
+
+    enum Flag : std::uint8_t {
+      HALF_CLOSED = 1 << 0,
+      // a WebSocket ping went out and no frame arrived since
+      PING_SENT = 1 << 1,
+      // set while the output queue is above the server's high watermark
+      READ_PAUSED = 1 << 2,
+      // input broke a limit, or the connection's last response was
+      // produced; that answer is being written and the connection closes
+      // once it is out
+      REJECTED = 1 << 3,
+      // accepted but not read from until the server's admission queue
+      // lets it through
+      AWAITING_ADMISSION = 1 << 4,
+      // an AF_UNIX socket: there is no host or port, the peer is known by
+      // its credentials
+      UNIX_DOMAIN = 1 << 5,
+      // set by handle_message, or shed_message on the loop thread, when its
+      // response is to be the last one on the connection; taken by its caller
+      CLOSE_AFTER_RESPONSE = 1 << 6,
+    };
+    // the flags that move with a handed off connection
+    static constexpr std::uint8_t PROTOCOL_FLAGS = HALF_CLOSED | PING_SENT | REJECTED;
+
   private:
     int socket_fd;
-    std::optional<std::string> host;
-    std::optional<int> port;
+    int reactor_id = 0;
+    ConnectionHandle handle;
+    // network byte order, port 0 when unknown; an AF_UNIX connection keeps
+    // its peer's pid here instead, 0 for a listener
+    std::uint32_t peer_address = 0;
+    std::uint16_t peer_port = 0;
+    // Protocol state is written by pool workers inside handle_message while
+    // the loop thread parses with it, hence atomics.
+    SocketAtomic<ConnectionPhase> phase{ConnectionPhase::HTTP};
+    SocketAtomic<std::uint8_t> flags{0};
+    SocketAtomic<ProtocolCallback> protocol_callback{nullptr};
+    // messages handled on this connection, counted by handle_message
+    SocketAtomic<std::uint32_t> handled{0};
+    // of an AF_UNIX connection's peer, next to peer_address's pid; placed
+    // here it takes what would be padding
+    std::uint32_t peer_uid = 0;
     std::chrono::steady_clock::time_point last_activity;
-    std::function<std::optional<std::string>(std::string)> protocol_callback;
-    std::unordered_map<std::string, bool> metadata;
-    bool half_closed = false;
-  
+    // deadline of the idle timer currently armed for this socket
+    std::chrono::steady_clock::time_point idle_deadline;
+    // when the incomplete message at the front of recv_buffer started to
+    // arrive, zero while there is none
+    std::chrono::steady_clock::time_point partial_since;
 
-    std::string recv_buffer;
-    std::string send_buffer;
+    ByteBuffer recv_buffer;
+    // loop thread only, like recv_buffer
+    FramingState framing;
+    SendQueue send_queue;
+    // owned, freed on close; null for plain connections
+    SSL* tls = nullptr;
 
 
     Result<int> check_connected(std::string message) const;
+    // SO_PEERCRED of an accepted AF_UNIX connection, kept for socket_info.
+    void read_peer_credentials();
+    // Only inbound data counts as activity. The owning server's idle timer
+    // picks the new deadline up from last_activity when it next fires.
     void touch();
+    void set_peer(const std::string& host, int port);
+    Result<bool> receive_tls(std::size_t max_unread);
+    Result<bool> send_tls();
+    void free_tls();
 
   
   public: 
 
   
 
-    void set_protocol_callback(std::function<std::optional<std::string>(std::string)> callback) {
-      protocol_callback = callback;
+    // The callback sees the unread input and returns the length of the next
+    // complete message at its start, or nullopt if there is none yet. state
+    // belongs to that message and survives until it is returned.
+    void set_protocol_callback(ProtocolCallback callback) {
+      protocol_callback.store(callback);
     }
 
-    void set_half_closed(bool value = true) {
-      half_closed = value;
+    ConnectionPhase get_phase() const {
+      return phase.load();
+    }
+    void set_phase(ConnectionPhase value) {
+      phase.store(value);
     }
 
-    bool is_half_closed() const {
-      return half_closed;
+    bool has_flag(Flag flag) const {
+      return flags.load() & flag;
+    }
+    void set_flag(Flag flag, bool value = true) {
+      if (value) {
+        flags.fetch_or(flag);
+      } else {
+        flags.fetch_and(static_cast<std::uint8_t>(~flag));
+      }
+    }
+    std::uint8_t get_flags() const {
+      return flags.load();
+    }
+    void set_flags(std::uint8_t value) {
+      flags.store(value);
     }
 
-    void set_metadata(const std::string& key, bool value) {
-      metadata[key] = value;
+    // Counts one more handled message and returns the total.
+    std::uint32_t count_handled() {
+      return handled.fetch_add(1) + 1;
+    }
+
+    void set_half_closed(bool value = true) {
+      set_flag(HALF_CLOSED, value);
     }
-    std::optional<bool> get_metadata(const std::string& key) const {
-      return metadata.find(key) != metadata.end() ? std::optional<bool>(metadata.at(key)) : std::nullopt;
+
+    bool is_half_closed() const {
+      return has_flag(HALF_CLOSED);
     }
 
     TcpSocket();
+    // Takes a descriptor that is already non-blocking.
     TcpSocket(int socket_fd, const std::string& host, int port);
 
-    Result<TcpSocket> listen(const std::string& host, int port, int max_connections = 10);
+    Result<TcpSocket> listen(const std::string& host, int port, int backlog = SOMAXCONN);
+    // Non-blocking AF_UNIX stream listener at path. A socket file left at
+    // path by an earlier run is replaced; options are applied before listen.
+    static Result<TcpSocket> listen_unix(const std::string& path, int backlog, const SocketOptions& options);
+    Result<int> set_reuse_port();
+    // Every option is tried; one the kernel refuses is logged and skipped.
+    void apply_options(const SocketOptions& options);
     //Result<TcpSocket> connect(const std::string& host, int port);
     Result<void*> hard_close();
     Result<int> close();
     Result<int> shutdown_read();
+    Result<int> shutdown_write();
+    Result<int> shutdown_read_write();
     Result<bool> drain();
 
-    void set_send_buffer(std::string data);
+    // Wraps the connection in a server side TLS session, established by the
+    // first reads. receive() and send() then carry plaintext, except that
+    // once the kernel encrypts (kTLS) sends go through the plain path.
+    Result<int> start_tls(SSL_CTX* context);
+    bool is_tls() const {
+      return tls != nullptr;
+    }
+    // The handshake stopped on a full socket buffer and goes on once the
+    // socket is writable again, from the read side.
+    bool tls_handshake_wants_write() const {
+      return tls != nullptr && !SSL_is_init_finished(tls) && SSL_want_write(tls);
+    }
+
+    // Queues data behind anything not sent yet; nothing queued is ever dropped.
+    void append_send_buffer(std::string data);
+    // Same for a buffer other sockets may be queuing too, e.g. a broadcast.
+    // A large one is queued by reference rather than copied.
+    void append_send_buffer(std::shared_ptr<const std::string> data);
     Result<bool> send();
+    std::size_t pending_send_bytes() const {
+      return send_queue.size();
+    }
     
-    Result<bool> receive();
+    // Stops early, before EAGAIN, once max_unread bytes are buffered.
+    Result<bool> receive(std::size_t max_unread = SIZE_MAX);
     std::vector<std::string> flush_messages();
+    // Input received but not taken by flush_messages() yet.
+    std::string_view peek_unread() const {
+      return recv_buffer.view();
+    }
+    // Moves out input that was received but not parsed into a message yet,
+    // and puts such input back, for handing a connection to another process.
+    std::string take_unread();
+    void restore_unread(std::string_view data);
+
+    // Completion side of receive() for the io_uring backend: result is the
+    // byte count of a finished recv into data, 0 on EOF or -errno.
+    // Returns true if the peer closed the connection.
+    Result<bool> complete_receive(int result, const char* data);
+    // Completion side of send(): hands the queued chunks to the caller, who
+    // puts back whatever the kernel did not send with requeue_send(),
+    // last chunk first.
+    std::vector<std::string> take_send_queue();
+    void requeue_send(std::string unsent);
+    bool has_pending_send() const {
+      return !send_queue.empty();
+    }
+
+    // Shared buffers of at least threshold bytes are then sent with
+    // MSG_ZEROCOPY. Fails where the socket does not support it, AF_UNIX
+    // sockets and kernels before 4.14 among them.
+    Result<int> enable_zerocopy(std::size_t threshold);
+    bool is_zerocopy_enabled() const {
+      return send_queue.is_zerocopy_enabled();
+    }
+    bool has_zerocopy_in_flight() const {
+      return send_queue.has_zerocopy_in_flight();
+    }
+    // The kernel reports finished zerocopy sends on the socket's error queue,
+    // which raises EPOLLERR. Reads them off and lets go of the buffers they
+    // held. Sends the kernel had to copy mean zerocopy only costs on this
+    // path, e.g. loopback, so it is switched off for the socket. Fails if
+    // the socket has a real error pending as well.
+    Result<ZerocopyCompletions> reap_zerocopy();
+    std::vector<std::shared_ptr<const std::string>> take_zerocopy_in_flight() {
+      return send_queue.take_zerocopy_in_flight();
+    }
+
+    void set_read_paused(bool value) {
+      set_flag(READ_PAUSED, value);
+    }
+    bool is_read_paused() const {
+      return has_flag(READ_PAUSED);
+    }
 
     void drain_buffer();
+    // Frees the storage of whichever buffer is empty. Called for connections
+    // that went idle, so a quiet connection costs little beyond the socket.
+    void release_buffers();
+    // The socket and the heap memory its buffers hold.
+    std::size_t memory_usage() const;
 
     
+    // Non-blocking, fails with EAGAIN once the backlog is empty.
     Result<TcpSocket> accept();
+    // Wraps a non-blocking descriptor that was accepted elsewhere, e.g. by
+    // io_uring.
+    static Result<TcpSocket> from_accepted_fd(int client_fd);
+    // Wraps a descriptor that is already bound and listening, e.g. one
+    // inherited from a previous process.
+    static Result<TcpSocket> from_listening_fd(int listen_fd);
 
     std::optional<std::string> get_host() const;
     std::optional<int> get_port() const;
+    bool is_unix_domain() const {
+      return has_flag(UNIX_DOMAIN);
+    }
+    // Read from the kernel once, when the connection is accepted or
+    // adopted; nullopt for TCP sockets and listeners.
+    std::optional<PeerCredentials> get_peer_credentials() const;
     int get_fd() const;
 
+    void set_reactor_id(int id) {
+      reactor_id = id;
+    }
+    int get_reactor_id() const {
+      return reactor_id;
+    }
+    // Set by the connection table on insert.
+    void set_handle(ConnectionHandle value) {
+      handle = value;
+    }
+    ConnectionHandle get_handle() const {
+      return handle;
+    }
+
     std::chrono::milliseconds time_since_last_activity() const;
+    std::chrono::steady_clock::time_point get_last_activity() const {
+      return last_activity;
+    }
+    void set_idle_deadline(std::chrono::steady_clock::time_point deadline) {
+      idle_deadline = deadline;
+    }
+    std::chrono::steady_clock::time_point get_idle_deadline() const {
+      return idle_deadline;
+    }
+    void set_partial_since(std::chrono::steady_clock::time_point since) {
+      partial_since = since;
+    }
+    std::chrono::steady_clock::time_point get_partial_since() const {
+      return partial_since;
+    }
     bool should_timeout(const std::chrono::seconds& timeout) const {
       if (timeout == std::chrono::seconds::max()) {
         return false;
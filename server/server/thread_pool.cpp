@@ -1,101 +1,275 @@
 #include "server/server/thread_pool.h"
-#include "server/server/tcp_socket.h"
+#include "server/utils/logger.h"
+#include <cstdint>
 #include <stdexcept>
 
-ThreadPool::ThreadPool(size_t n,std::function<void(TcpSocket&)> handle_job_callback) : 
-    handle_job_callback(handle_job_callback), stop_flag(false) {
+namespace {
+// Lets enqueue from inside a handler go to the worker's own deque.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t n,std::function<void(ConnectionHandle, std::string)> handle_job_callback) : 
+    handle_job_callback(handle_job_callback), injector(INJECTOR_CAPACITY), high_lane(INJECTOR_CAPACITY), stop_flag(false) {
+        local_queues.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            local_queues.push_back(std::make_unique<WorkStealingDeque<SocketState*>>());
+        }
         workers.reserve(n);
         for (size_t i = 0; i < n; ++i) {
-            workers.emplace_back(&ThreadPool::worker_loop, this);
+            workers.emplace_back(&ThreadPool::worker_loop, this, static_cast<int>(i));
         }
 }
 
 ThreadPool::~ThreadPool() {
     {
-        std::unique_lock<std::mutex> lock(mtx);
+        std::unique_lock<std::mutex> lock(park_mtx);
         stop_flag = true;
     }
-    cv.notify_all();
+    park_cv.notify_all();
     for (auto& t : workers) t.join();
+
+    for (auto& shard : shards) {
+        for (auto& [connection, state] : shard.states) {
+            delete state;
+        }
+    }
 }
 
-void ThreadPool::enqueue(TcpSocket& socket) {
+ThreadPool::Shard& ThreadPool::shard_for(ConnectionHandle connection) {
+    std::uint64_t key = connection.pack();
+    return shards[(key * 0x9E3779B97F4A7C15ull) >> 58];
+}
+
+void ThreadPool::enqueue(ConnectionHandle connection, std::string message, Priority priority) {
+    SocketState* to_schedule = nullptr;
+    Priority lane = priority;
     {
-        std::unique_lock<std::mutex> lock(mtx);
-        TcpSocket* socket_ptr = &socket;
-        auto& state = socket_states[socket_ptr];
-        state.pending++;
-        if (!state.active && !state.queued) {
-            job_queue.push(&socket);
-            state.queued = true;
+        Shard& shard = shard_for(connection);
+        std::lock_guard<std::mutex> shard_lock(shard.mtx);
+        SocketState*& state = shard.states[connection];
+        if (state == nullptr) {
+            state = new SocketState();
+            state->connection = connection;
+        }
+
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->pending.push_back(Job{std::move(message), priority, std::chrono::steady_clock::now()});
+        if (!state->active && !state->queued) {
+            state->queued = true;
+            lane = state->pending.front().priority;
+            to_schedule = state;
         }
     }
-    cv.notify_one();
+    if (to_schedule != nullptr) {
+        schedule(to_schedule, lane, current_pool == this ? current_worker : -1);
+    }
 }
 
-void ThreadPool::dequeue(TcpSocket& socket) {
-    std::unique_lock<std::mutex> lock(mtx);
-    TcpSocket* target = &socket;
-
-    if (!job_queue.empty()) {
-        std::queue<TcpSocket*> new_queue;
-        while (!job_queue.empty()) {
-            TcpSocket* candidate = job_queue.front();
-            job_queue.pop();
-            if (candidate == target) {
-                continue;
-            }
-            new_queue.push(candidate);
+std::size_t ThreadPool::dequeue(ConnectionHandle connection) {
+    SocketState* to_release = nullptr;
+    std::size_t dropped = 0;
+    {
+        Shard& shard = shard_for(connection);
+        std::lock_guard<std::mutex> shard_lock(shard.mtx);
+        auto it = shard.states.find(connection);
+        if (it == shard.states.end()) {
+            return 0;
+        }
+        SocketState* state = it->second;
+        shard.states.erase(it);
+
+        // A queued state is skipped and freed by the worker that pops it, an
+        // active one by the worker running it; nothing scans the queues.
+        std::lock_guard<std::mutex> lock(state->mtx);
+        dropped = state->pending.size();
+        state->pending.clear();
+        state->cancelled = true;
+        if (!state->active && !state->queued) {
+            to_release = state;
         }
-        job_queue.swap(new_queue);
     }
+    delete to_release;
+    cancelled += dropped;
+    return dropped;
+}
 
-    socket_states.erase(target);
+ThreadPool::Stats ThreadPool::get_stats() const {
+    Stats stats;
+    stats.queue_depth = static_cast<std::size_t>(std::max<std::int64_t>(0, queued_tasks.load()));
+    stats.executed = executed.load(std::memory_order_relaxed);
+    stats.steals = steals.load(std::memory_order_relaxed);
+    stats.steal_attempts = steal_attempts.load(std::memory_order_relaxed);
+    stats.cancelled = cancelled.load(std::memory_order_relaxed);
+    return stats;
 }
 
-void ThreadPool::worker_loop() {
-    while (true) {
-        TcpSocket* socket_ptr = nullptr;
-        {
-            std::unique_lock<std::mutex> lock(mtx);
-            cv.wait(lock, [&] { return stop_flag || !job_queue.empty(); });
-            if (stop_flag && job_queue.empty()) return;
-            socket_ptr = job_queue.front();
-            job_queue.pop();
-            auto& state = socket_states[socket_ptr];
-            state.queued = false;
-            state.active = true;
-            if (state.pending > 0) {
-                state.pending--;
-            }
+std::array<ThreadPool::LaneStats, PRIORITY_COUNT> ThreadPool::get_lane_stats() {
+    std::array<LaneStats, PRIORITY_COUNT> stats;
+    for (std::size_t i = 0; i < PRIORITY_COUNT; ++i) {
+        Lane& lane = lanes[i];
+        LaneStats& lane_stats = stats[i];
+        lane_stats.queue_depth = static_cast<std::size_t>(std::max<std::int64_t>(0, lane.queued.load()));
+        lane_stats.executed = lane.executed.load(std::memory_order_relaxed);
+        lane_stats.wait = std::chrono::microseconds(lane.wait_us.load(std::memory_order_relaxed));
+        lane_stats.max_wait = std::chrono::microseconds(lane.max_wait_us.exchange(0, std::memory_order_relaxed));
+    }
+    return stats;
+}
+
+void ThreadPool::schedule(SocketState* state, Priority lane, int worker_index) {
+    state->lane = lane;
+    queued_tasks.fetch_add(1);
+    lanes[static_cast<std::size_t>(lane)].queued.fetch_add(1);
+    if (lane == Priority::HIGH) {
+        while (!high_lane.try_push(state)) {
+            std::this_thread::yield();
         }
-        if (socket_ptr == nullptr) {
-            throw std::runtime_error("Socket pointer is null");
+    } else if (worker_index >= 0) {
+        local_queues[worker_index]->push(state);
+    } else {
+        while (!injector.try_push(state)) {
+            std::this_thread::yield();
         }
+    }
+    wake_one();
+}
 
-        bool rethrow = false;
-        try {
-            handle_job_callback(*socket_ptr);
-        } catch (...) {
-            rethrow = true;
+void ThreadPool::wake_one() {
+    if (sleeping.load() == 0) return;
+    std::lock_guard<std::mutex> lock(park_mtx);
+    park_cv.notify_one();
+}
+
+ThreadPool::SocketState* ThreadPool::find_task(int worker_index, unsigned& seed, int& high_streak) {
+    std::optional<SocketState*> task;
+    bool normal_first = high_streak >= HIGH_STREAK;
+    if (!normal_first) task = high_lane.try_pop();
+    if (task) {
+        ++high_streak;
+    } else {
+        high_streak = 0;
+        task = find_normal_task(worker_index, seed);
+        // the streak ran out but nothing else is waiting
+        if (!task && normal_first) task = high_lane.try_pop();
+    }
+
+    if (!task) return nullptr;
+    queued_tasks.fetch_sub(1);
+    lanes[static_cast<std::size_t>((*task)->lane)].queued.fetch_sub(1);
+    return *task;
+}
+
+std::optional<ThreadPool::SocketState*> ThreadPool::find_normal_task(int worker_index, unsigned& seed) {
+    std::optional<SocketState*> task = local_queues[worker_index]->pop();
+    if (!task) task = injector.try_pop();
+
+    const int worker_count = static_cast<int>(local_queues.size());
+    for (int round = 0; !task && worker_count > 1 && round < STEAL_ROUNDS; ++round) {
+        seed = seed * 1103515245u + 12345u;
+        int victim = static_cast<int>((seed >> 16) % worker_count);
+        if (victim == worker_index) continue;
+        steal_attempts.fetch_add(1, std::memory_order_relaxed);
+        task = local_queues[victim]->steal();
+        if (task) steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    // random victims missed, sweep everyone once before going to sleep
+    for (int victim = 0; !task && victim < worker_count; ++victim) {
+        if (victim == worker_index) continue;
+        task = local_queues[victim]->steal();
+        if (task) steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+// Several workers may update the average at once; a lost update drops one
+// sample, which the average does not miss.
+void ThreadPool::record_wait(Priority priority, std::chrono::steady_clock::duration wait) {
+    Lane& lane = lanes[static_cast<std::size_t>(priority)];
+    std::int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+    lane.executed.fetch_add(1, std::memory_order_relaxed);
+    std::int64_t average = lane.wait_us.load(std::memory_order_relaxed);
+    lane.wait_us.store(average + (sample - average) / 16, std::memory_order_relaxed);
+    std::int64_t longest = lane.max_wait_us.load(std::memory_order_relaxed);
+    while (sample > longest &&
+           !lane.max_wait_us.compare_exchange_weak(longest, sample, std::memory_order_relaxed)) {
+    }
+}
+
+void ThreadPool::run_task(SocketState* state, int worker_index) {
+    ConnectionHandle connection;
+    std::string message;
+    Priority priority;
+    std::chrono::steady_clock::time_point enqueued;
+    {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        state->queued = false;
+        if (state->cancelled) {
+            lock.unlock();
+            delete state;
+            return;
         }
+        if (state->pending.empty()) return;
+        Job& job = state->pending.front();
+        message = std::move(job.message);
+        priority = job.priority;
+        enqueued = job.enqueued;
+        state->pending.pop_front();
+        state->active = true;
+        connection = state->connection;
+    }
+
+    record_wait(priority, std::chrono::steady_clock::now() - enqueued);
+    // a throwing job must not take the worker, and the process, with it
+    try {
+        handle_job_callback(connection, std::move(message));
+    } catch (const std::exception& e) {
+        Logger::instance().error("Job of fd " + std::to_string(connection.fd) + " threw: " + e.what());
+    } catch (...) {
+        Logger::instance().error("Job of fd " + std::to_string(connection.fd) + " threw");
+    }
+    executed.fetch_add(1, std::memory_order_relaxed);
 
-        {
-            std::unique_lock<std::mutex> lock(mtx);
-            auto it = socket_states.find(socket_ptr);
-            if (it != socket_states.end()) {
-                auto& state = it->second;
-                state.active = false;
-                if (state.pending > 0) {
-                    job_queue.push(socket_ptr);
-                    state.queued = true;
-                    cv.notify_one();
-                } else {
-                    socket_states.erase(it);
-                }
-            }
+    bool release = false;
+    bool reschedule = false;
+    Priority lane = Priority::NORMAL;
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->active = false;
+        if (state->cancelled) {
+            release = true;
+        } else if (!state->pending.empty()) {
+            state->queued = true;
+            reschedule = true;
+            lane = state->pending.front().priority;
+        }
+    }
+    if (release) delete state;
+    else if (reschedule) schedule(state, lane, worker_index);
+}
+
+void ThreadPool::worker_loop(int worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+    unsigned seed = static_cast<unsigned>(worker_index) * 2654435761u + 1u;
+    int high_streak = 0;
+
+    while (true) {
+        SocketState* state = find_task(worker_index, seed, high_streak);
+        if (state != nullptr) {
+            run_task(state, worker_index);
+            continue;
+        }
+        if (queued_tasks.load() > 0) {
+            // a producer is between counting and pushing its task
+            std::this_thread::yield();
+            continue;
         }
 
-        if (rethrow) throw;
+        std::unique_lock<std::mutex> lock(park_mtx);
+        if (stop_flag) return;
+        sleeping.fetch_add(1);
+        park_cv.wait(lock, [&] { return stop_flag || queued_tasks.load() > 0; });
+        sleeping.fetch_sub(1);
     }
 }
@@ -1,35 +1,129 @@
 #pragma once
 
-#include "tcp_socket.h"
+#include "server/server/connection_handle.h"
+#include "server/server/mpmc_queue.h"
+#include "server/server/priority.h"
+#include "server/server/work_stealing_deque.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
+#include <string>
 #include <thread>
 #include <vector>
 #include <condition_variable>
 #include <unordered_map>
 
+// Work-stealing executor. Every worker owns a Chase-Lev deque, sockets with
+// new work enter through a shared lock-free injection queue, and idle
+// workers steal from random victims. A socket is in at most one queue at a
+// time, which keeps its messages ordered without a global lock.
+//
+// A socket whose next message is Priority::HIGH is queued in the high lane
+// instead, one shared FIFO that every worker checks first. So that a steady
+// stream of high work cannot starve the rest, a worker that took
+// HIGH_STREAK high tasks in a row takes normal work next if there is any.
+// A socket's messages stay in order across lanes: a high message queued
+// behind a normal one of the same socket waits for it.
 class ThreadPool {
 public:
-    ThreadPool(size_t n,std::function<void(TcpSocket&)> handle_job_callback);
+    struct LaneStats {
+        std::size_t queue_depth = 0;
+        std::uint64_t executed = 0;
+        // time from enqueue until a worker took the message, smoothed over
+        // roughly the last 16 messages
+        std::chrono::microseconds wait{0};
+        // longest wait since the previous get_lane_stats()
+        std::chrono::microseconds max_wait{0};
+    };
+
+    struct Stats {
+        std::size_t queue_depth = 0;
+        std::uint64_t executed = 0;
+        std::uint64_t steals = 0;
+        std::uint64_t steal_attempts = 0;
+        std::uint64_t cancelled = 0;
+    };
+
+    ThreadPool(size_t n,std::function<void(ConnectionHandle, std::string)> handle_job_callback);
     ~ThreadPool();
-    void enqueue(TcpSocket& socket);
-    void dequeue(TcpSocket& socket);
+    // Messages of one socket are handled one at a time, in the order they were enqueued.
+    void enqueue(ConnectionHandle connection, std::string message, Priority priority = Priority::NORMAL);
+    // Drops every pending message of the socket and returns how many were
+    // dropped. A job that is already running is not interrupted.
+    std::size_t dequeue(ConnectionHandle connection);
+
+    Stats get_stats() const;
+    // Indexed by Priority. Starts the next max_wait period, so meant for
+    // one reader that reports periodically.
+    std::array<LaneStats, PRIORITY_COUNT> get_lane_stats();
 
 private:
+    struct Job {
+        std::string message;
+        Priority priority;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
     struct SocketState {
-        std::size_t pending = 0;
+        ConnectionHandle connection;
+        std::mutex mtx;
+        std::deque<Job> pending;
+        // lane the state is queued in, that of its front job
+        Priority lane = Priority::NORMAL;
         bool active = false;
         bool queued = false;
+        // set by dequeue; whoever holds the state in a queue or runs it frees it
+        bool cancelled = false;
     };
 
-    std::function<void(TcpSocket&)> handle_job_callback;
+    // Socket lookup is sharded so concurrent reactors rarely share a lock.
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<ConnectionHandle, SocketState*> states;
+    };
+    static constexpr std::size_t SHARD_COUNT = 64;
+    static constexpr std::size_t INJECTOR_CAPACITY = 1 << 17;
+    static constexpr int STEAL_ROUNDS = 4;
+    static constexpr int HIGH_STREAK = 8;
+
+    struct Lane {
+        std::atomic<std::int64_t> queued{0};
+        std::atomic<std::uint64_t> executed{0};
+        std::atomic<std::int64_t> wait_us{0};
+        std::atomic<std::int64_t> max_wait_us{0};
+    };
+
+    std::function<void(ConnectionHandle, std::string)> handle_job_callback;
     std::vector<std::thread> workers;
-    std::queue<TcpSocket*> job_queue;
-    std::unordered_map<TcpSocket*, SocketState> socket_states;
-    std::mutex mtx;
-    std::condition_variable cv;
-    bool stop_flag;
-
-    void worker_loop();
-};
\ No newline at end of file
+    std::vector<std::unique_ptr<WorkStealingDeque<SocketState*>>> local_queues;
+    MpmcQueue<SocketState*> injector;
+    MpmcQueue<SocketState*> high_lane;
+    std::array<Lane, PRIORITY_COUNT> lanes;
+    std::array<Shard, SHARD_COUNT> shards;
+
+    std::mutex park_mtx;
+    std::condition_variable park_cv;
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stop_flag;
+
+    std::atomic<std::int64_t> queued_tasks{0};
+    std::atomic<std::uint64_t> executed{0};
+    std::atomic<std::uint64_t> steals{0};
+    std::atomic<std::uint64_t> steal_attempts{0};
+    std::atomic<std::uint64_t> cancelled{0};
+
+    Shard& shard_for(ConnectionHandle connection);
+    void schedule(SocketState* state, Priority lane, int worker_index);
+    void wake_one();
+    // high_streak counts the worker's consecutive high lane tasks.
+    SocketState* find_task(int worker_index, unsigned& seed, int& high_streak);
+    std::optional<SocketState*> find_normal_task(int worker_index, unsigned& seed);
+    void record_wait(Priority lane, std::chrono::steady_clock::duration wait);
+    void run_task(SocketState* state, int worker_index);
+    void worker_loop(int worker_index);
+};
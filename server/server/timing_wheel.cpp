@@ -0,0 +1,112 @@
+#include "server/server/timing_wheel.h"
+
+#include <algorithm>
+
+TimingWheel::TimingWheel(std::chrono::milliseconds tick)
+    : tick(tick), origin(Clock::now()) {}
+
+std::uint64_t TimingWheel::tick_of(Clock::time_point time_point, bool round_up) const {
+    if (time_point <= origin) return 0;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(time_point - origin);
+    auto rounding = round_up ? tick.count() - 1 : 0;
+    return static_cast<std::uint64_t>((elapsed.count() + rounding) / tick.count());
+}
+
+TimingWheel::Clock::time_point TimingWheel::time_of(std::uint64_t tick_index) const {
+    return origin + tick * static_cast<std::int64_t>(tick_index);
+}
+
+void TimingWheel::place(Entry entry) {
+    if (entry.tick <= current_tick) {
+        entry.tick = current_tick + 1;
+    }
+    std::uint64_t delta = entry.tick - current_tick;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    if (level == LEVELS - 1) {
+        // beyond the top level: park it at the furthest slot, it cascades again later
+        std::uint64_t horizon = (1ull << (SLOT_BITS * LEVELS)) - 1;
+        if (delta > horizon) {
+            entry.tick = current_tick + horizon;
+        }
+    }
+    std::uint64_t slot = (entry.tick >> (SLOT_BITS * level)) & SLOT_MASK;
+    slots[level][slot].push_back(entry);
+}
+
+void TimingWheel::schedule(ConnectionHandle handle, Clock::time_point deadline) {
+    // round up so a timer never fires before its deadline
+    place(Entry{Timer{handle, deadline}, tick_of(deadline, true)});
+    ++count;
+}
+
+void TimingWheel::cascade(int level) {
+    std::uint64_t slot = (current_tick >> (SLOT_BITS * level)) & SLOT_MASK;
+    std::vector<Entry> entries;
+    entries.swap(slots[level][slot]);
+    for (auto& entry : entries) {
+        if (entry.tick == current_tick) {
+            // due on the tick being processed right now
+            slots[0][current_tick & SLOT_MASK].push_back(entry);
+        } else {
+            place(entry);
+        }
+    }
+}
+
+std::vector<TimingWheel::Timer> TimingWheel::advance(Clock::time_point now) {
+    std::vector<Timer> expired;
+    std::uint64_t target = tick_of(now, false);
+
+    if (count == 0) {
+        current_tick = std::max(current_tick, target);
+        return expired;
+    }
+
+    while (current_tick < target && count > 0) {
+        ++current_tick;
+        for (int level = LEVELS - 1; level > 0; --level) {
+            if ((current_tick & ((1ull << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+        auto& due = slots[0][current_tick & SLOT_MASK];
+        for (auto& entry : due) {
+            expired.push_back(entry.timer);
+        }
+        count -= due.size();
+        due.clear();
+    }
+    current_tick = std::max(current_tick, target);
+    return expired;
+}
+
+std::optional<std::chrono::milliseconds> TimingWheel::time_until_next(Clock::time_point now) const {
+    if (count == 0) return std::nullopt;
+
+    // Level 0 gives the exact next deadline; for higher levels the wheel has
+    // to wake up at the start of the next occupied block to cascade it.
+    std::optional<std::uint64_t> next_tick;
+    for (int level = 0; level < LEVELS; ++level) {
+        std::uint64_t shift = SLOT_BITS * level;
+        for (std::uint64_t i = 1; i <= SLOTS; ++i) {
+            std::uint64_t slot_tick = level == 0 ? current_tick + i : ((current_tick >> shift) + i) << shift;
+            if (next_tick && slot_tick >= *next_tick) break;
+            if (!slots[level][(slot_tick >> shift) & SLOT_MASK].empty()) {
+                next_tick = slot_tick;
+                break;
+            }
+        }
+    }
+    if (!next_tick) return std::chrono::milliseconds(0);
+
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(time_of(*next_tick) - now);
+    return std::max(wait, std::chrono::milliseconds(0));
+}
+
+std::size_t TimingWheel::size() const {
+    return count;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "server/server/connection_handle.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Hierarchical timing wheel for connection deadlines. Four levels of 64
+// slots; level 0 has one slot per tick, every further level is 64 times
+// coarser and cascades into the level below when the wheel reaches it.
+// Scheduling is O(1) and advancing costs O(expired + cascaded).
+// Entries are never removed early; owners drop the ones whose handle went
+// stale or that were re-armed since.
+class TimingWheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        ConnectionHandle handle;
+        Clock::time_point deadline;
+    };
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100));
+
+    void schedule(ConnectionHandle handle, Clock::time_point deadline);
+    // Moves the wheel up to now and returns every timer that is due.
+    std::vector<Timer> advance(Clock::time_point now);
+    // Time until the wheel next needs advance(), nullopt when it is empty.
+    std::optional<std::chrono::milliseconds> time_until_next(Clock::time_point now) const;
+
+    std::size_t size() const;
+
+  private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr std::uint64_t SLOTS = 1ull << SLOT_BITS;
+    static constexpr std::uint64_t SLOT_MASK = SLOTS - 1;
+
+    struct Entry {
+        Timer timer;
+        std::uint64_t tick;
+    };
+
+    std::chrono::milliseconds tick;
+    Clock::time_point origin;
+    std::uint64_t current_tick = 0;
+    std::size_t count = 0;
+    std::array<std::array<std::vector<Entry>, SLOTS>, LEVELS> slots;
+
+    std::uint64_t tick_of(Clock::time_point time_point, bool round_up) const;
+    Clock::time_point time_of(std::uint64_t tick_index) const;
+    void place(Entry entry);
+    void cascade(int level);
+};
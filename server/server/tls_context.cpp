@@ -0,0 +1,86 @@
+#include "server/server/tls_context.h"
+
+#include <openssl/err.h>
+
+std::string last_ssl_error() {
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (code == 0) return "no OpenSSL error";
+    char message[256];
+    ERR_error_string_n(code, message, sizeof(message));
+    return message;
+}
+
+TlsContext::~TlsContext() {
+    if (context != nullptr) SSL_CTX_free(context);
+}
+
+Result<int> TlsContext::setup(const Options& options) {
+    context = SSL_CTX_new(TLS_server_method());
+    if (context == nullptr) {
+        return Result<int>(Error("Failed to create TLS context: " + last_ssl_error()));
+    }
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    // renegotiation would need the write path to read and the reverse; a
+    // peer that closes without close_notify reads as a plain EOF
+    std::uint64_t flags = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+#ifdef SSL_OP_ENABLE_KTLS
+    if (options.ktls) flags |= SSL_OP_ENABLE_KTLS;
+#endif
+    SSL_CTX_set_options(context, flags);
+    // SendQueue retries with its front chunk, which may have been appended
+    // to; idle connections give their record buffers back
+    SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(context, options.certificate_file.c_str()) != 1) {
+        return Result<int>(Error("Failed to load TLS certificate " + options.certificate_file + ": " + last_ssl_error()));
+    }
+    if (SSL_CTX_use_PrivateKey_file(context, options.private_key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(context) != 1) {
+        return Result<int>(Error("Failed to load TLS private key " + options.private_key_file + ": " + last_ssl_error()));
+    }
+
+    static const unsigned char session_id_context[] = "wordle";
+    SSL_CTX_set_session_id_context(context, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(context, static_cast<long>(options.session_cache_size));
+    SSL_CTX_set_timeout(context, static_cast<long>(options.session_lifetime.count()));
+    // one ticket is enough for a client that reconnects to one server
+    SSL_CTX_set_num_tickets(context, 1);
+
+    SSL_CTX_set_app_data(context, this);
+    SSL_CTX_set_info_callback(context, &TlsContext::on_info);
+    return Result<int>(0);
+}
+
+std::string TlsContext::get_ticket_keys() const {
+    std::string keys(TICKET_KEYS_SIZE, '\0');
+    if (SSL_CTX_get_tlsext_ticket_keys(context, keys.data(), keys.size()) != 1) return "";
+    return keys;
+}
+
+Result<int> TlsContext::set_ticket_keys(const std::string& keys) {
+    std::string copy = keys;
+    if (copy.size() != TICKET_KEYS_SIZE ||
+        SSL_CTX_set_tlsext_ticket_keys(context, copy.data(), copy.size()) != 1) {
+        return Result<int>(Error("Failed to set TLS ticket keys"));
+    }
+    return Result<int>(0);
+}
+
+TlsContext::Stats TlsContext::get_stats() const {
+    Stats stats;
+    stats.handshakes = handshakes.load(std::memory_order_relaxed);
+    stats.resumed = resumed.load(std::memory_order_relaxed);
+    stats.ktls_send = ktls_send.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TlsContext::on_info(const SSL* ssl, int where, int) {
+    if (!(where & SSL_CB_HANDSHAKE_DONE)) return;
+    auto* self = static_cast<TlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    self->handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(ssl)) self->resumed.fetch_add(1, std::memory_order_relaxed);
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl))) self->ktls_send.fetch_add(1, std::memory_order_relaxed);
+}
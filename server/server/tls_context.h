@@ -0,0 +1,65 @@
+#pragma once
+
+#include "server/utils/result.h"
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Server side OpenSSL context shared by every listener that terminates TLS.
+// A reconnecting client skips the full handshake by presenting a session
+// ticket or, for TLS 1.2 clients without ticket support, a session id from
+// the shared cache. With ktls set the symmetric crypto moves into the kernel
+// once the handshake is done, where the kernel and OpenSSL support it, so
+// sends go out through the plain writev path.
+class TlsContext {
+  public:
+    struct Options {
+        std::string certificate_file;
+        std::string private_key_file;
+        std::size_t session_cache_size = 20480;
+        std::chrono::seconds session_lifetime{7200};
+        bool ktls = true;
+    };
+
+    struct Stats {
+        std::uint64_t handshakes = 0;
+        std::uint64_t resumed = 0;
+        std::uint64_t ktls_send = 0;
+    };
+
+    // Size of the ticket keys exchanged with get/set_ticket_keys().
+    static constexpr std::size_t TICKET_KEYS_SIZE = 80;
+
+    TlsContext() = default;
+    ~TlsContext();
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    Result<int> setup(const Options& options);
+    SSL_CTX* get() const {
+      return context;
+    }
+
+    // The keys tickets are sealed with. Handing them to a successor process
+    // lets clients it reconnects resume instead of redoing the handshake.
+    std::string get_ticket_keys() const;
+    Result<int> set_ticket_keys(const std::string& keys);
+
+    Stats get_stats() const;
+
+  private:
+    SSL_CTX* context = nullptr;
+    std::atomic<std::uint64_t> handshakes{0};
+    std::atomic<std::uint64_t> resumed{0};
+    std::atomic<std::uint64_t> ktls_send{0};
+
+    static void on_info(const SSL* ssl, int where, int ret);
+};
+
+// Latest OpenSSL error queue entry, for error messages.
+std::string last_ssl_error();
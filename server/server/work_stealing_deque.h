@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models", PPoPP 2013).
+// The owning worker pushes and pops at the bottom, any other thread may
+// steal from the top. T must be trivially copyable (pointers in practice).
+template <typename T>
+class WorkStealingDeque {
+  private:
+    struct Buffer {
+        std::size_t capacity;
+        std::size_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+
+        explicit Buffer(std::size_t capacity)
+            : capacity(capacity), mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+        T load(std::int64_t index) const {
+            return slots[static_cast<std::size_t>(index) & mask].load(std::memory_order_relaxed);
+        }
+        void store(std::int64_t index, T value) {
+            slots[static_cast<std::size_t>(index) & mask].store(value, std::memory_order_relaxed);
+        }
+    };
+
+    alignas(64) std::atomic<std::int64_t> top{0};
+    alignas(64) std::atomic<std::int64_t> bottom{0};
+    std::atomic<Buffer*> buffer;
+    // Thieves may still read a buffer after it was replaced, so old buffers
+    // are only released together with the deque.
+    std::vector<std::unique_ptr<Buffer>> retired;
+
+    Buffer* grow(Buffer* old, std::int64_t b, std::int64_t t) {
+        auto bigger = std::make_unique<Buffer>(old->capacity * 2);
+        for (std::int64_t i = t; i < b; ++i) {
+            bigger->store(i, old->load(i));
+        }
+        Buffer* raw = bigger.get();
+        retired.push_back(std::move(bigger));
+        buffer.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+  public:
+    explicit WorkStealingDeque(std::size_t capacity = 1024) {
+        auto initial = std::make_unique<Buffer>(capacity);
+        buffer.store(initial.get(), std::memory_order_relaxed);
+        retired.push_back(std::move(initial));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void push(T value) {
+        std::int64_t b = bottom.load(std::memory_order_relaxed);
+        std::int64_t t = top.load(std::memory_order_acquire);
+        Buffer* current = buffer.load(std::memory_order_relaxed);
+        if (b - t > static_cast<std::int64_t>(current->capacity) - 1) {
+            current = grow(current, b, t);
+        }
+        current->store(b, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    std::optional<T> pop() {
+        std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* current = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T value = current->load(b);
+        if (t == b) {
+            // last element, race against thieves for it
+            bool won = top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            if (!won) return std::nullopt;
+        }
+        return value;
+    }
+
+    // Any thread.
+    std::optional<T> steal() {
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return std::nullopt;
+
+        Buffer* current = buffer.load(std::memory_order_consume);
+        T value = current->load(t);
+        if (!top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    // Approximate when called concurrently with push/pop/steal.
+    std::size_t size() const {
+        std::int64_t b = bottom.load(std::memory_order_relaxed);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+};
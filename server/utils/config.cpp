@@ -1,6 +1,7 @@
 #include "server/utils/config.h"
 #include "nlohmann/json.hpp"
 #include <fstream>
+#include <functional>
 #include <iostream>
 
 using json = nlohmann::json;
@@ -32,12 +33,17 @@ void Config::load_config() {
         config_file >> j;
         config_file.close();
 
-        // Load all config values from JSON
-        for (auto& [key, value] : j.items()) {
-            if (value.is_string()) {
-                config[key] = value.get<std::string>();
+        // Load all config values from JSON, nested sections as "section.key"
+        std::function<void(const json&, const std::string&)> load = [&](const json& object, const std::string& prefix) {
+            for (auto& [key, value] : object.items()) {
+                if (value.is_string()) {
+                    config[prefix + key] = value.get<std::string>();
+                } else if (value.is_object()) {
+                    load(value, prefix + key + ".");
+                }
             }
-        }
+        };
+        load(j, "");
 
         // If allowed_origin exists, call the setter
         if (j.contains("allowed_origin") && j["allowed_origin"].is_string()) {
@@ -29,6 +29,10 @@ void Error::handle_error(bool should_exit) const {
     throw std::runtime_error(message);
 }
 
+int Error::get_errno() const {
+    return errno_value;
+}
+
 HttpStatusCode Error::get_http_status_code() const {
     return http_status_code;
 }
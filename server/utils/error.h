@@ -15,6 +15,7 @@ class Error {
     std::string get_message(bool include_errno = true) const;
     void handle_error(bool should_exit = false) const;
     HttpStatusCode get_http_status_code() const;
+    int get_errno() const;
 };
 
 
@@ -235,7 +235,7 @@ void Logger::request_result_info(
     const std::optional<std::string>& host, 
     const std::optional<int>& port) {
     std::string info_string = 
-    "[REQUEST] " + method_to_string(request.get_method()) + " " + request.get_path() + " " 
+    "[REQUEST] " + method_to_string(request.get_method()) + " " + std::string(request.get_path()) + " " 
         + status_code_to_string(response.get_status_code()) + " "
         + get_status_message(response.get_status_code())
         + " from " + host.value_or("unknown") + ":" + std::to_string(port.value_or(0));
@@ -48,34 +48,35 @@ std::string compute_web_socket_accept(std::string client_key) {
 HttpResponse handshake_response(std::string key){
     std::string response_key = compute_web_socket_accept(key);
 
-    return HttpResponse(
+    HttpResponse response(
         std::nullopt,
         HttpVersion::HTTP_1_1,
         HttpStatusCode::SWITCHING_PROTOCOLS
-    )
-    .add_header(HttpHeader("Upgrade", "websocket"))
-    .add_header(HttpHeader("Connection", "Upgrade"))
-    .add_header(HttpHeader("Sec-WebSocket-Accept",response_key));
+    );
+    response.add_header(HttpHeader("Upgrade", "websocket"))
+        .add_header(HttpHeader("Connection", "Upgrade"))
+        .add_header(HttpHeader("Sec-WebSocket-Accept",response_key));
+    return response;
 }
 
 
 Result<std::string> handshake_request(const HttpRequest& request){
-    auto headers = request.get_headers();
-    auto upgrade = headers.find("Upgrade");
-    auto connection = headers.find("Connection");
-    auto sec_websocket_key = headers.find("Sec-WebSocket-Key");
+    auto upgrade = request.get_header("Upgrade");
+    auto connection = request.get_header("Connection");
+    auto sec_websocket_key = request.get_header("Sec-WebSocket-Key");
 
-    if (upgrade == headers.end() || upgrade->second != "websocket"){
+    // both are token lists matched without case, as in
+    // "Connection: keep-alive, Upgrade"
+    if (!upgrade.has_value() || !HttpParser::has_token(*upgrade, "websocket")){
         return Error("Upgrade header missing");
     }
-    if (connection == headers.end() || connection->second != "Upgrade"){
+    if (!connection.has_value() || !HttpParser::has_token(*connection, "upgrade")){
         return Error("Connection header missing");
     }
-    if (sec_websocket_key== headers.end()){
+    if (!sec_websocket_key.has_value()){
         return Error("Sec-WebSocket-Key header missing");
     }
 
 
-    return sec_websocket_key->second;
-}
-
+    return std::string(*sec_websocket_key);
+}
\ No newline at end of file
@@ -4,6 +4,24 @@
 #include <string>
 #include <arpa/inet.h>
 
+std::optional<WebSocketFrame::Extent> WebSocketFrame::peek_extent(std::string_view data) {
+    if (data.size() < 2) return std::nullopt;
+    uint8_t byte1 = static_cast<uint8_t>(data[1]);
+    uint8_t payload_len = byte1 & 0x7F;
+
+    Extent extent{2, payload_len};
+    std::size_t length_bytes = payload_len == 126 ? 2 : payload_len == 127 ? 8 : 0;
+    extent.header += length_bytes + ((byte1 & 0x80) ? 4 : 0);
+    if (data.size() < extent.header) return std::nullopt;
+    if (length_bytes > 0) {
+        extent.payload = 0;
+        for (std::size_t i = 0; i < length_bytes; ++i) {
+            extent.payload = (extent.payload << 8) | static_cast<uint8_t>(data[2 + i]);
+        }
+    }
+    return extent;
+}
+
 // ============================================================================
 // Factory: Parse raw WebSocket frame data
 // ============================================================================
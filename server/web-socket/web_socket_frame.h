@@ -3,6 +3,7 @@
 #include <vector>
 #include <cstdint>
 #include <array>
+#include <optional>
 #include <string>
 #include <string_view>
 #include "server/utils/result.h"
@@ -52,6 +53,14 @@ class WebSocketFrame {
         // --- Construction ---
         WebSocketFrame() = default;
     
+        // Size of the frame header at the start of data and the payload
+        // length it announces, nullopt until the whole header has arrived.
+        struct Extent {
+            std::size_t header;
+            uint64_t payload;
+        };
+        static std::optional<Extent> peek_extent(std::string_view data);
+
         // Factories
         static Result<WebSocketFrame> from_raw_data(const std::vector<uint8_t>& data);
         static Result<WebSocketFrame> from_raw_data(std::string_view data);
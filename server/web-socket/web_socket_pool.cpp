@@ -1,28 +1,27 @@
 #include "server/web-socket/web_socket_pool.h"
 #include "server/web-socket/web_socket_frame.h"
-#include "server/utils/logger.h"
+#include "server/web-socket/web_socket_server.h"
 
-void WebSocketPool::set_connections(std::unordered_map<int, TcpSocket>& connections) {
-    this->connections = &connections;
+#include <algorithm>
+#include <memory>
+
+void WebSocketPool::add_server(WebSocketServer& server) {
+    atomic([&]() {
+        servers.push_back(&server);
+    });
 }
 
-void WebSocketPool::broadcast_all(const nlohmann::json& json) {
-    if (!connections || connections->empty()) return;
+void WebSocketPool::remove_server(WebSocketServer& server) {
     atomic([&]() {
-        auto logger = &Logger::instance();
-        for (auto& [fd, connection] : *connections) {
-            auto frame = WebSocketFrame::text(json.dump());
-            
-            connection.set_send_buffer(frame.to_string());
-            connection.send();
-            logger->info("Broadcasted to connection: " + connection.socket_info());
-        }
+        servers.erase(std::remove(servers.begin(), servers.end(), &server), servers.end());
     });
 }
 
-bool WebSocketPool::is_socket_connected(const TcpSocket& socket) const {
-    if (!connections || connections->empty()) return false;
-    return atomic([&]() {
-        return connections->find(socket.get_fd()) != connections->end();
+void WebSocketPool::broadcast_all(const nlohmann::json& json) {
+    auto frame = std::make_shared<const std::string>(WebSocketFrame::text(json.dump()).to_string());
+    atomic([&]() {
+        for (auto* server : servers) {
+            server->broadcast(frame);
+        }
     });
 }
\ No newline at end of file
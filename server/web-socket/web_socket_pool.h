@@ -1,19 +1,22 @@
 #pragma once
 
-#include <unordered_map>
+#include <vector>
 #include "nlohmann/json.hpp"
 #include "server/utils/global_state.h"
-#include "server/server/tcp_socket.h"
+
+class WebSocketServer;
 
 class WebSocketPool : public GlobalState<WebSocketPool> {
     private:
-        std::unordered_map<int, TcpSocket>* connections = nullptr;
+        std::vector<WebSocketServer*> servers;
 
     public:
         WebSocketPool() = default;
         ~WebSocketPool() = default;
         
-        void set_connections(std::unordered_map<int, TcpSocket>& connections);
+        void add_server(WebSocketServer& server);
+        void remove_server(WebSocketServer& server);
+        // Serializes the frame once and posts it to the loop threads of every
+        // server; returns without waiting for the writes.
         void broadcast_all(const nlohmann::json& json);
-        bool is_socket_connected(const TcpSocket& socket) const;
 };
\ No newline at end of file
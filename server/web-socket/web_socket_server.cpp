@@ -1,26 +1,57 @@
 #include "server/web-socket/web_socket_server.h"
 #include "server/utils/result.h"
 #include "server/web-socket/handshake.h"
+#include "server/http/http_parser.h"
 #include "server/http/http_request.h"
+#include "server/http/http_response.h"
 #include <string>
 #include "server/web-socket/web_socket_frame.h"
 
 
+// Handshake requests, framed by their header and Content-Length.
+static std::optional<std::size_t> next_request(std::string_view data, FramingState& state) {
+    return HttpParser::frame(data, state);
+}
+
+// One whole frame; fragmented messages arrive as separate frames. The frame
+// header is short enough to re-read on every call.
+static std::optional<std::size_t> next_frame(std::string_view data, FramingState&) {
+    auto extent = WebSocketFrame::peek_extent(data);
+    if (!extent.has_value() || extent->payload > data.size() - extent->header) return std::nullopt;
+    return extent->header + extent->payload;
+}
+
 WebSocketServer::WebSocketServer() : TcpServer() {
-    set_client_timeout(std::chrono::seconds::max());
-    WebSocketPool::instance().set_connections(connections);
+    set_client_timeout(std::chrono::seconds(120));
+}
+
+WebSocketServer::~WebSocketServer() {
+    WebSocketPool::instance().remove_server(*this);
 }
 
 
 void WebSocketServer::start(int port, std::string address) {
-    Logger::instance().info("Starting WebSocket server on " + address + ":" + std::to_string(port));
+    Logger::instance().info("Starting WebSocket server on " + describe_address(port, address));
     TcpServer::start(port, address);
+    WebSocketPool::instance().add_server(*this);
+}
+
+void WebSocketServer::broadcast(std::shared_ptr<const std::string> frame) {
+    post_to_connections([this, frame](TcpSocket& client_socket) {
+        if (client_socket.get_phase() != ConnectionPhase::WEBSOCKET) return;
+        client_socket.append_send_buffer(frame);
+        schedule_flush(client_socket);
+        Logger::instance().info("Broadcasted to connection: " + client_socket.socket_info());
+    });
 }
 
 Result<std::string> WebSocketServer::handle_message(TcpSocket& socket, std::string message) {
-    auto handshake_status = socket.get_metadata("handshake_status");
-    if(!handshake_status.has_value()) {
+    if(socket.get_phase() == ConnectionPhase::HTTP) {
         HttpRequest request(message);
+        if(!request.is_valid()) {
+            HttpResponse response = HttpResponse::from_json(Error("Malformed request", HttpStatusCode::BAD_REQUEST));
+            return Result<std::string>(response.to_string());
+        }
 
         bool is_get_request = request.get_method() == HttpMethod::GET;
         bool is_ws_path = request.get_path() == "/ws";
@@ -38,26 +69,28 @@ Result<std::string> WebSocketServer::handle_message(TcpSocket& socket, std::stri
         }
 
         auto response = handshake_response(handshake_key.unwrap());
-        socket.set_metadata("handshake_status", true);
-        socket.set_protocol_callback([&](std::string data) {
-            //should switch to websocket frame handling
-            if (data.empty()) return std::optional<std::string>();
-            return std::optional<std::string>(data);
-        });
+        socket.set_phase(ConnectionPhase::WEBSOCKET);
+        socket.set_protocol_callback(next_frame);
         return Result<std::string>(response.to_string());
 
-    }else if(handshake_status) {
+    }else{
         auto frame_result = WebSocketFrame::from_raw_data(message);
         if(frame_result.is_err()) {
             WebSocketFrame response = WebSocketFrame::close(WsCloseCode::PROTOCOL_ERROR);
             Logger::instance().error("Failed to parse frame from client " + socket.socket_info());
-            socket.set_metadata("half_closed", true);
+            socket.set_half_closed();
             return Result<std::string>(response.to_string());
         }
         auto frame = frame_result.unwrap();
+        socket.set_flag(TcpSocket::PING_SENT, false);
+        if(frame.opcode == WsOpcode::Pong) {
+            return Result<std::string>(std::string());
+        }
+        if(frame.opcode == WsOpcode::Ping) {
+            return Result<std::string>(WebSocketFrame::pong(frame.payload).to_string());
+        }
         if(frame.opcode == WsOpcode::Close) {
             WebSocketFrame response = WebSocketFrame::close(WsCloseCode::NORMAL_CLOSURE);
-            socket.set_send_buffer(response.to_string());
             socket.set_half_closed();
             return Result<std::string>(response.to_string());
         }
@@ -68,18 +101,53 @@ Result<std::string> WebSocketServer::handle_message(TcpSocket& socket, std::stri
         //echo todo
         auto response = WebSocketFrame::text(frame_payload);
         return Result<std::string>(response.to_string());
-
-    }else{
-        Logger::instance().error("Handshake failed for client " + socket.socket_info());
-        return Error("Unexpected message handler status");
     }
 }
 
+bool WebSocketServer::on_client_idle(TcpSocket& client_socket) {
+    if (client_socket.get_phase() != ConnectionPhase::WEBSOCKET) return true;
+    if (client_socket.has_flag(TcpSocket::PING_SENT)) return true;
+
+    Logger::instance().debug("Pinging idle client " + client_socket.socket_info());
+    client_socket.set_flag(TcpSocket::PING_SENT);
+    client_socket.append_send_buffer(WebSocketFrame::ping().to_string());
+    write_until_eagain(client_socket);
+    return false;
+}
+
 void WebSocketServer::on_client_connected(TcpSocket& client_socket) {
-    client_socket.set_protocol_callback([&](std::string data) {
-        // should add http callback
-        if (data.empty()) return std::optional<std::string>();
-        return std::optional<std::string>(data);
-    });
+    // an adopted connection may be past its handshake already
+    if (client_socket.get_phase() == ConnectionPhase::WEBSOCKET) {
+        client_socket.set_protocol_callback(next_frame);
+    } else {
+        client_socket.set_protocol_callback(next_request);
+    }
+}
+
+std::string WebSocketServer::retry_later_response(std::chrono::seconds retry_after) {
+    HttpStatusCode status = HttpStatusCode::SERVICE_UNAVAILABLE;
+    return HttpResponse::from_json(Result<nlohmann::json>(Error(get_status_message(status), status)))
+        .add_header(HttpHeader("Retry-After", std::to_string(retry_after.count())))
+        .close_connection()
+        .to_string();
+}
+
+std::optional<std::string> WebSocketServer::check_limits(TcpSocket& client_socket, std::string_view input) {
+    const Limits& limits = get_limits();
+    if (client_socket.get_phase() == ConnectionPhase::HTTP) {
+        auto status = HttpParser::check_limits(input, limits.max_header_bytes, limits.max_body_bytes);
+        if (!status.has_value()) return std::nullopt;
+        count_limit(*status == HttpStatusCode::PAYLOAD_TOO_LARGE ? Limit::BODY : Limit::HEADER);
+        Logger::instance().warn("Rejecting handshake from " + client_socket.socket_info() + ": " + get_status_message(*status));
+        return HttpResponse::from_json(Result<nlohmann::json>(Error(get_status_message(*status), *status)))
+            .close_connection()
+            .to_string();
+    }
+
+    auto extent = WebSocketFrame::peek_extent(input);
+    if (!extent.has_value() || extent->payload <= limits.max_frame_bytes) return std::nullopt;
+    count_limit(Limit::FRAME);
+    Logger::instance().warn("Rejecting frame of " + std::to_string(extent->payload) + " bytes from " + client_socket.socket_info());
+    return WebSocketFrame::close(WsCloseCode::MESSAGE_TOO_BIG).to_string();
 }
    
@@ -7,10 +7,20 @@ class WebSocketServer : public TcpServer{
 
     protected:
         void on_client_connected(TcpSocket& client_socket) override;
+        std::optional<std::string> check_limits(TcpSocket& client_socket, std::string_view input) override;
+        // 503 with Retry-After, sent before the handshake request is read.
+        std::string retry_later_response(std::chrono::seconds retry_after) override;
         Result<std::string> handle_message(TcpSocket& socket, std::string message) override;
+        // Pings an idle client once and closes it only if the ping goes unanswered.
+        bool on_client_idle(TcpSocket& client_socket) override;
 
     public:
         void start(int port, std::string address);
+        // Queues frame to every connection that completed the handshake. Each
+        // reactor writes it from its own loop thread; the connections share
+        // the one buffer.
+        void broadcast(std::shared_ptr<const std::string> frame);
         WebSocketServer();
+        ~WebSocketServer();
 
 };
\ No newline at end of file